@@ -0,0 +1,16 @@
+TEMPLATE += app
+
+# Files
+HEADERS += $$files(include/*.hpp)
+SOURCES += src/bench.cpp
+
+# Executable Name
+TARGET = mines-bench.exe
+
+# Headless, so no QT
+CONFIG += console thread
+CONFIG -= qt app_bundle
+
+# Specify C++ version
+CONFIG += c++23
+QMAKE_CXXFLAGS += -std=c++23 -O2
@@ -0,0 +1,346 @@
+#ifndef MINESWEEPER_CHUNKED
+#define MINESWEEPER_CHUNKED
+
+#include "mines.hpp"
+#include "random.hpp"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace minesweeper {
+  // A board generated a chunk at a time as it is explored, so memory follows the area played rather than the size of
+  // the board. Each chunk has its own stream split from the seed, and whether a tile holds a mine is the number at its
+  // place in that stream, so chunks can be generated in any order, and the counts along a chunk's edges need nothing
+  // from the chunks next to it.
+  // A width or height of 0 leaves the board endless in that direction.
+  //
+  // Mines are placed independently at the given density, so their total is never known and the game cannot be won.
+  // It goes on until a mine is revealed.
+  class chunked_game {
+    public:
+      using tile = game::tile;
+      using status = game::status;
+
+      // Tiles along each side of a chunk
+      static constexpr int CHUNK_BITS = 6;
+      static constexpr std::int64_t CHUNK = 1 << CHUNK_BITS;
+
+      // Chunk coordinates are packed into 32 bits each, which bounds even an endless board
+      static constexpr std::int64_t LIMIT = CHUNK << 31;
+
+      chunked_game(std::uint64_t seed, double density, std::int64_t width = 0, std::int64_t height = 0)
+        : streams(seed), columns(width), rows(height) {
+        if (width < 0 || height < 0 || width > LIMIT || height > LIMIT) {
+          throw std::invalid_argument("Invalid width or height of game board.");
+        }
+        if (!(density >= 0 && density <= 1)) {
+          throw std::out_of_range("Mine density must be between 0 and 1.");
+        }
+
+        this->threshold = density >= 1 ? UINT64_MAX : (std::uint64_t)(density * 18446744073709551616.0);
+      }
+
+      // Returns how many tiles were revealed
+      size_t reveal(std::int64_t row, std::int64_t col) {
+        this->checkPosition(row, col);
+
+        // The first reveal opens on a blank tile, and any chunks already loaded by flags are brought into line
+        if (this->firstReveal) {
+          this->firstReveal = false;
+          this->openingRow = row;
+          this->openingCol = col;
+
+          for (std::int64_t r = row - 2; r <= row + 2; ++r) {
+            for (std::int64_t c = col - 2; c <= col + 2; ++c) {
+              if (this->onBoard(r, c) && this->chunks.contains(this->chunkKey(r, c))) {
+                this->refresh(r, c);
+              }
+            }
+          }
+        }
+
+        const size_t before = this->revealedSafe + this->mineRevealed;
+        tile& t = this->tileAt(row, col);
+
+        if (!t.isFlagged() && !t.isRevealed()) {
+          if (this->revealTile(t) && !t.isMine() && t.adjacentMineCount() == 0) {
+            this->floodFill(row, col);
+          }
+        } else if (
+            t.isRevealed() && !t.isMine() &&
+            (t.adjacentMineCount() == 0 || this->adjacentFlagCount(row, col) == t.adjacentMineCount())
+          ) {
+          // Reveal the surrounding tiles if the tile is blank or the number of flags match the number of mines
+          this->forEachNeighbour(row, col, [this](std::int64_t r, std::int64_t c) {
+            tile& n = this->tileAt(r, c);
+
+            if (this->revealTile(n) && !n.isMine() && n.adjacentMineCount() == 0) {
+              this->floodFill(r, c);
+            }
+          });
+        }
+
+        return this->revealedSafe + this->mineRevealed - before;
+      }
+
+      // Returns whether the tile's flag changed
+      bool flag(std::int64_t row, std::int64_t col) {
+        this->checkPosition(row, col);
+
+        tile& t = this->tileAt(row, col);
+        if (!t.flag()) {
+          return false;
+        }
+
+        if (t.isFlagged()) {
+          ++this->flaggedTiles;
+        } else {
+          --this->flaggedTiles;
+        }
+        return true;
+      }
+
+      // Tiles in chunks that have not been loaded yet are hidden, and read as blank until they are
+      tile at(std::int64_t row, std::int64_t col) const {
+        this->checkPosition(row, col);
+
+        const auto found = this->chunks.find(this->chunkKey(row, col));
+        if (found == this->chunks.end()) {
+          return tile();
+        }
+
+        return found->second[tileIndex(row, col)];
+      }
+
+      // Whether a tile holds a mine, without loading its chunk, for showing the mines once the game is lost
+      bool isMine(std::int64_t row, std::int64_t col) const {
+        return this->isMine(row, col, this->streams.split(this->chunkKey(row, col)));
+      }
+
+      status state() const {
+        return this->mineRevealed ? status::LOST : status::PLAYING;
+      }
+
+      bool isMineRevealed() const {
+        return this->mineRevealed;
+      }
+
+      size_t revealedCount() const {
+        return this->revealedSafe;
+      }
+
+      size_t flagCount() const {
+        return this->flaggedTiles;
+      }
+
+      // 0 when the board is endless in that direction
+      std::int64_t width() const {
+        return this->columns;
+      }
+
+      std::int64_t height() const {
+        return this->rows;
+      }
+
+      size_t loadedChunks() const {
+        return this->chunks.size();
+      }
+
+    private:
+      // Spreads out the chunk keys, which only differ in their low bits
+      struct chunk_hash {
+        size_t operator()(std::uint64_t key) const {
+          return random_engine::mix(key);
+        }
+      };
+
+      // Largest number of tiles one flood fill reveals, since an endless board at a low density could otherwise
+      // open forever. The blank tiles left at the edge can be revealed again to carry on.
+      static constexpr size_t FLOOD_LIMIT = 1 << 22;
+
+      static std::uint64_t chunkKey(std::int64_t row, std::int64_t col) {
+        return (std::uint64_t)(std::uint32_t)(row >> CHUNK_BITS) << 32 | (std::uint32_t)(col >> CHUNK_BITS);
+      }
+
+      static size_t tileIndex(std::int64_t row, std::int64_t col) {
+        return (row & (CHUNK - 1)) << CHUNK_BITS | (col & (CHUNK - 1));
+      }
+
+      bool isMine(std::int64_t row, std::int64_t col, const random_engine& chunkStream) const {
+        if (!this->onBoard(row, col)) {
+          return false;
+        }
+
+        if (!this->firstReveal && row >= this->openingRow - 1 && row <= this->openingRow + 1 &&
+            col >= this->openingCol - 1 && col <= this->openingCol + 1) {
+          return false;
+        }
+
+        return chunkStream.at(tileIndex(row, col)) < this->threshold;
+      }
+
+      bool onBoard(std::int64_t row, std::int64_t col) const {
+        return (this->rows == 0 ? row >= -LIMIT && row < LIMIT : row >= 0 && row < this->rows) &&
+          (this->columns == 0 ? col >= -LIMIT && col < LIMIT : col >= 0 && col < this->columns);
+      }
+
+      void checkPosition(std::int64_t row, std::int64_t col) const {
+        if (!this->onBoard(row, col)) {
+          throw std::out_of_range("Tile position is outside of the game board.");
+        }
+      }
+
+      // Call function(row, col) for every neighbour of a tile that lies on the board
+      template<typename Function>
+      void forEachNeighbour(std::int64_t row, std::int64_t col, Function&& function) const {
+        for (const auto& [rowOffset, colOffset] : game_types::NEIGHBOURS) {
+          if (this->onBoard(row + rowOffset, col + colOffset)) {
+            function(row + rowOffset, col + colOffset);
+          }
+        }
+      }
+
+      // The tile at a position, generating its chunk if this is the first time it has been touched
+      tile& tileAt(std::int64_t row, std::int64_t col) {
+        const std::uint64_t key = this->chunkKey(row, col);
+
+        if (this->cachedChunk == nullptr || this->cachedKey != key) {
+          std::unique_ptr<tile[]>& slot = this->chunks[key];
+          if (!slot) {
+            slot = this->generate(row >> CHUNK_BITS << CHUNK_BITS, col >> CHUNK_BITS << CHUNK_BITS);
+          }
+
+          this->cachedChunk = slot.get();
+          this->cachedKey = key;
+        }
+
+        return this->cachedChunk[tileIndex(row, col)];
+      }
+
+      // A chunk's tiles in row-major order
+      std::unique_ptr<tile[]> generate(std::int64_t top, std::int64_t left) const {
+        // Mines over the chunk and the ring of tiles around it, so the counts along its edges are right
+        constexpr std::int64_t SIDE = CHUNK + 2;
+        std::array<bool, SIDE * SIDE> mined;
+        std::uint64_t lastKey = this->chunkKey(top, left);
+        random_engine stream = this->streams.split(lastKey);
+        for (std::int64_t r = 0; r < SIDE; ++r) {
+          for (std::int64_t c = 0; c < SIDE; ++c) {
+            // The ring around the chunk lies in the neighbouring chunks, which have streams of their own
+            const std::uint64_t key = this->chunkKey(top + r - 1, left + c - 1);
+            if (key != lastKey) {
+              lastKey = key;
+              stream = this->streams.split(key);
+            }
+
+            mined[r * SIDE + c] = this->isMine(top + r - 1, left + c - 1, stream);
+          }
+        }
+
+        std::unique_ptr<tile[]> generated(new tile[CHUNK * CHUNK]);
+        for (std::int64_t r = 0; r < CHUNK; ++r) {
+          for (std::int64_t c = 0; c < CHUNK; ++c) {
+            const size_t centre = (r + 1) * SIDE + c + 1;
+            std::uint8_t bits = mined[centre] ? tile::MINED : 0;
+
+            for (const auto& [rowOffset, colOffset] : game_types::NEIGHBOURS) {
+              bits += mined[centre + rowOffset * SIDE + colOffset];
+            }
+
+            generated[r * CHUNK + c].bits = bits;
+          }
+        }
+
+        return generated;
+      }
+
+      // Work out a loaded tile's mine and count again, keeping whether it is revealed or flagged
+      void refresh(std::int64_t row, std::int64_t col) {
+        tile& t = this->tileAt(row, col);
+        std::uint8_t bits = (t.bits & (tile::REVEALED | tile::FLAGGED)) | (this->isMine(row, col) ? tile::MINED : 0);
+
+        this->forEachNeighbour(row, col, [this, &bits](std::int64_t r, std::int64_t c) {
+          bits += this->isMine(r, c);
+        });
+
+        t.bits = bits;
+      }
+
+      bool revealTile(tile& t) {
+        if (!t.reveal()) {
+          return false;
+        }
+
+        if (t.isMine()) {
+          this->mineRevealed = true;
+        } else {
+          ++this->revealedSafe;
+        }
+
+        return true;
+      }
+
+      // Reveal the area around an already revealed blank tile, across chunk borders as they come.
+      // Tiles are taken in the order they were found, so the area grows evenly and touches as few chunks as it can.
+      void floodFill(std::int64_t row, std::int64_t col) {
+        size_t revealed = 0;
+
+        this->fillQueue.clear();
+        this->fillQueue.emplace_back(row, col);
+        while (!this->fillQueue.empty() && revealed < FLOOD_LIMIT) {
+          const auto [r, c] = this->fillQueue.front();
+          this->fillQueue.pop_front();
+
+          this->forEachNeighbour(r, c, [this, &revealed](std::int64_t nr, std::int64_t nc) {
+            tile& n = this->tileAt(nr, nc);
+
+            // None of the tiles a flood fill reaches can be mines
+            if (n.reveal()) {
+              ++revealed;
+              if (n.adjacentMineCount() == 0) {
+                this->fillQueue.emplace_back(nr, nc);
+              }
+            }
+          });
+        }
+
+        this->revealedSafe += revealed;
+      }
+
+      unsigned short int adjacentFlagCount(std::int64_t row, std::int64_t col) {
+        unsigned short int count = 0;
+
+        this->forEachNeighbour(row, col, [this, &count](std::int64_t r, std::int64_t c) {
+          count += this->tileAt(r, c).isFlagged();
+        });
+
+        return count;
+      }
+
+    private:
+      // Every chunk's stream is split from this by its key
+      random_engine streams;
+      // Tiles hold a mine when their hash falls below this
+      std::uint64_t threshold;
+      std::int64_t columns, rows;
+
+      std::unordered_map<std::uint64_t, std::unique_ptr<tile[]>, chunk_hash> chunks;
+      // The chunk used last, since most lookups land in the same chunk as the one before
+      tile* cachedChunk = nullptr;
+      std::uint64_t cachedKey = 0;
+      std::deque<std::pair<std::int64_t, std::int64_t>> fillQueue;
+
+      bool firstReveal = true;
+      std::int64_t openingRow = 0, openingCol = 0;
+
+      size_t revealedSafe = 0, flaggedTiles = 0;
+      bool mineRevealed = false;
+  };
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
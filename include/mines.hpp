@@ -1,12 +1,32 @@
 #ifndef MINESWEEPER
 #define MINESWEEPER
 
+#include "random.hpp"
+#include "varint.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <deque>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
-#include <unordered_set>
-#include <random>
 #include <stdexcept>
+#include <fcntl.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static inline std::pair<size_t, size_t> intToCoords(size_t width, unsigned long int num) {
   return std::pair<size_t, size_t>{num / width, num % width};
@@ -17,53 +37,55 @@ static inline unsigned long int coordsToInt(size_t width, const std::pair<size_t
 }
 
 namespace minesweeper {
-  class game {
+  class chunked_game;
+
+  template<unsigned int W, unsigned int H>
+  class basic_game;
+
+  // The types shared by games of every size, so code written against one works with all of them
+  class game_types {
     public:
       class tile {
         public:
           bool isRevealed() const {
-            return this->revealed;
+            return this->bits & REVEALED;
           }
 
           bool isFlagged() const {
-            return this->flagged;
+            return this->bits & FLAGGED;
           }
 
           bool isMine() const {
-            return this->mined;
+            return this->bits & MINED;
           }
 
           unsigned short int adjacentMineCount() const {
-            return this->adjacentMines;
-          }
-
-          unsigned short int adjacentFlagCount() const {
-            return this->adjacentFlags;
+            return this->bits & ADJACENT;
           }
 
           // Return a character representing the tile
           explicit operator char() const {
-            if (this->flagged) {
+            if (this->isFlagged()) {
               return 'F';
             }
 
-            if (this->mined) {
+            if (this->isMine()) {
               return '*';
             }
 
-            if (this->adjacentMines == 0) {
+            if (this->adjacentMineCount() == 0) {
               return ' ';
             }
 
-            return '0' + this->adjacentMines;
+            return '0' + this->adjacentMineCount();
           }
 
         private:
           tile() {}
 
           bool flag() {
-            if (!this->revealed) {
-              this->flagged = !this->flagged;
+            if (!this->isRevealed()) {
+              this->bits ^= FLAGGED;
               return true;
             } else {
               return false;
@@ -71,30 +93,286 @@ namespace minesweeper {
           }
 
           bool reveal() {
-            if (!this->flagged && !this->revealed) {
-              this->revealed = true;
+            if (!this->isFlagged() && !this->isRevealed()) {
+              this->bits |= REVEALED;
               return true;
             } else {
               return false;
             }
           }
 
-          friend minesweeper::game;
+          template<unsigned int, unsigned int>
+          friend class minesweeper::basic_game;
+          friend minesweeper::game_types;
+          friend minesweeper::chunked_game;
+
+        private:
+          // Low nibble holds the adjacent mine count, the rest are state flags
+          static constexpr std::uint8_t ADJACENT = 0x0f;
+          static constexpr std::uint8_t REVEALED = 0x10;
+          static constexpr std::uint8_t FLAGGED = 0x20;
+          static constexpr std::uint8_t MINED = 0x40;
+          // Sentinel tiles padding the edge of the board
+          static constexpr std::uint8_t BORDER = 0x80;
+
+          std::uint8_t bits = 0;
+      };
+
+      static_assert(sizeof(tile) == 1, "Tiles must stay packed into a single byte");
+
+      // Lightweight read-only view over the row-major tile buffer
+      class grid_view {
+        public:
+          grid_view(const tile* tiles, size_t width, size_t height, size_t stride)
+            : tiles(tiles), columns(width), rows(height), stride(stride) {}
+
+          // Unchecked access, for callers that already know the position is valid
+          const tile& operator()(size_t row, size_t col) const {
+            return this->tiles[(row + 1) * this->stride + col + 1];
+          }
+
+          const tile& at(size_t row, size_t col) const {
+            if (row >= this->rows || col >= this->columns) {
+              throw std::out_of_range("Tile position is outside of the game board.");
+            }
+
+            return (*this)(row, col);
+          }
+
+          std::span<const tile> row(size_t row) const {
+            return std::span<const tile>(&(*this)(row, 0), this->columns);
+          }
+
+          size_t width() const {
+            return this->columns;
+          }
+
+          size_t height() const {
+            return this->rows;
+          }
+
+        private:
+          const tile* tiles;
+          size_t columns, rows, stride;
+      };
+
+      enum struct status : std::uint8_t {
+        PLAYING = 0,
+        WON = 1,
+        LOST = 2
+      };
+
+      // Row and column offsets of the eight surrounding tiles
+      static constexpr std::array<std::pair<int, int>, 8> NEIGHBOURS = {{
+        {-1, -1}, {-1, 0}, {-1, 1},
+        { 0, -1},          { 0, 1},
+        { 1, -1}, { 1, 0}, { 1, 1}
+      }};
+
+      // The tiles whose visible state changed during an action, or a batch of actions, and how the counters moved
+      class change_set {
+        public:
+          // A horizontal run of changed tiles
+          struct run {
+            size_t row, col, length;
+          };
+
+          const std::vector<run>& runs() const {
+            return this->changed;
+          }
+
+          bool empty() const {
+            return this->changed.empty();
+          }
+
+          long int revealedDelta() const {
+            return (long int)this->revealedAfter - (long int)this->revealedBefore;
+          }
+
+          long int flagDelta() const {
+            return (long int)this->flagsAfter - (long int)this->flagsBefore;
+          }
+
+          // When the game is won or lost every tile may need to be redrawn, not just the changed ones
+          bool stateChanged() const {
+            return this->stateBefore != this->stateAfter;
+          }
+
+          status state() const {
+            return this->stateAfter;
+          }
+
+        private:
+          template<unsigned int, unsigned int>
+          friend class minesweeper::basic_game;
+
+          std::vector<run> changed;
+          size_t revealedBefore = 0, revealedAfter = 0;
+          size_t flagsBefore = 0, flagsAfter = 0;
+          status stateBefore = status::PLAYING, stateAfter = status::PLAYING;
+      };
+
+    protected:
+      // Tiles either owned by the game or mapped in from a save file. Copies always own their tiles, so that two
+      // games never share one mapping.
+      class tile_buffer {
+        public:
+          tile_buffer() {}
+
+          tile_buffer(const tile_buffer& other) {
+            *this = other;
+          }
+
+          tile_buffer(tile_buffer&& other) noexcept {
+            *this = std::move(other);
+          }
+
+          tile_buffer& operator=(const tile_buffer& other) {
+            if (this != &other) {
+              this->mapping.reset();
+              this->owned.assign(other.begin(), other.end());
+              this->tiles = this->owned.data();
+              this->count = this->owned.size();
+            }
+            return *this;
+          }
+
+          tile_buffer& operator=(tile_buffer&& other) noexcept {
+            if (this != &other) {
+              this->owned = std::move(other.owned);
+              this->mapping = std::move(other.mapping);
+              this->tiles = std::exchange(other.tiles, nullptr);
+              this->count = std::exchange(other.count, 0);
+            }
+            return *this;
+          }
+
+          void assign(size_t size, const tile& value) {
+            this->mapping.reset();
+            this->owned.assign(size, value);
+            this->tiles = this->owned.data();
+            this->count = size;
+          }
+
+          // Use tiles that live elsewhere, kept alive by mapping
+          void map(tile* data, size_t size, std::shared_ptr<void> mapping) {
+            this->owned = std::vector<tile>();
+            this->mapping = std::move(mapping);
+            this->tiles = data;
+            this->count = size;
+          }
+
+          tile& operator[](size_t index) {
+            return this->tiles[index];
+          }
+
+          const tile& operator[](size_t index) const {
+            return this->tiles[index];
+          }
+
+          tile* data() {
+            return this->tiles;
+          }
+
+          const tile* data() const {
+            return this->tiles;
+          }
+
+          tile* begin() {
+            return this->tiles;
+          }
+
+          tile* end() {
+            return this->tiles + this->count;
+          }
+
+          const tile* begin() const {
+            return this->tiles;
+          }
+
+          const tile* end() const {
+            return this->tiles + this->count;
+          }
+
+          size_t size() const {
+            return this->count;
+          }
+
+        private:
+          std::vector<tile> owned;
+          std::shared_ptr<void> mapping;
+          tile* tiles = nullptr;
+          size_t count = 0;
+      };
+
+      // Tiles held inside the game itself, for boards whose size is known at compile time
+      template<size_t N>
+      class fixed_tile_buffer {
+        public:
+          void assign(size_t, const tile& value) {
+            std::fill_n(this->tiles, N, value);
+          }
+
+          tile& operator[](size_t index) {
+            return this->tiles[index];
+          }
+
+          const tile& operator[](size_t index) const {
+            return this->tiles[index];
+          }
+
+          tile* data() {
+            return this->tiles;
+          }
+
+          const tile* data() const {
+            return this->tiles;
+          }
+
+          tile* begin() {
+            return this->tiles;
+          }
+
+          tile* end() {
+            return this->tiles + N;
+          }
+
+          const tile* begin() const {
+            return this->tiles;
+          }
+
+          const tile* end() const {
+            return this->tiles + N;
+          }
+
+          static constexpr size_t size() {
+            return N;
+          }
 
         private:
-          bool revealed = false;
-          bool flagged = false;
-          bool mined = false;
-          unsigned short int adjacentMines = 0;
-          unsigned short int adjacentFlags = 0;
+          tile tiles[N];
       };
+  };
+
+  // A game of minesweeper. With W and H of 0 the board is sized at runtime; otherwise the size is fixed at compile
+  // time and the tiles live inside the game, so the stride and neighbour offsets fold into constants.
+  template<unsigned int W = 0, unsigned int H = 0>
+  class basic_game : public game_types {
+    static_assert((W == 0) == (H == 0), "Either both or neither of the width and height must be fixed");
+
+    public:
+      static constexpr bool FIXED = W != 0;
 
       tile& tileAt(size_t row, size_t col) {
-        return this->grid.at(row).at(col);
+        if (row >= this->height() || col >= this->width()) {
+          throw std::out_of_range("Tile position is outside of the game board.");
+        }
+
+        return this->grid[this->index(row, col)];
       }
 
       const tile& tileAt(size_t row, size_t col) const {
-        return this->grid.at(row).at(col);
+        return const_cast<basic_game*>(this)->tileAt(row, col);
       }
 
       tile& tileAt(const std::pair<size_t, size_t>& coords) {
@@ -106,222 +384,1417 @@ namespace minesweeper {
       }
 
     public:
-      game(unsigned int width, unsigned int height, unsigned long int mineCount) {
-        // Initialise the random number generator
-        this->rng.seed(std::chrono::high_resolution_clock::now().time_since_epoch().count());
-        this->rng.discard(5);
+      basic_game(unsigned int width, unsigned int height, unsigned long int mineCount)
+        : basic_game(width, height, mineCount, std::chrono::high_resolution_clock::now().time_since_epoch().count()) {}
 
+      // Deal a board that is the same for the same seed on every machine
+      basic_game(unsigned int width, unsigned int height, unsigned long int mineCount, std::uint64_t seed) : rng(seed) {
         this->initialise(width, height, mineCount);
       }
 
+      // Fixed size games only need the mine count
+      explicit basic_game(unsigned long int mineCount) requires FIXED
+        : basic_game(W, H, mineCount) {}
+
+      basic_game(unsigned long int mineCount, std::uint64_t seed) requires FIXED
+        : basic_game(W, H, mineCount, seed) {}
+
+      // Restart the random number generator, so the boards dealt from here on can be repeated
+      void seed(std::uint64_t value) {
+        this->rng.seed(value);
+      }
+
+      // The generator boards are dealt from, which may be replaced by a stream split from another
+      random_engine& generator() {
+        return this->rng;
+      }
+
       void initialise(unsigned int width, unsigned int height, unsigned long int mineCount) {
-        if (width == 0 || height == 0) {
+        if (width == 0 || height == 0 || (FIXED && (width != W || height != H))) {
           throw std::invalid_argument("Invalid width or height of game board.");
         }
-        if (mineCount > width * height) {
+        if (mineCount > (size_t)width * height) {
           throw std::out_of_range("Requested mine count exceeds size of board.");
         }
 
         // Reset game state
-        this->mines.clear();
-        this->flags.clear();
+        this->mineTotal = mineCount;
         this->firstReveal = true;
-        {
-          std::vector<tile> row(width, tile());
-          this->grid = std::vector<std::vector<tile>>(height, row);
-        }
-
-        // Create distribution to generate mines
-        std::uniform_int_distribution<unsigned long int> distribution(0, (unsigned long int)(width * height) - 1);
+        this->revealedSafe = 0;
+        this->flaggedTiles = 0;
+        this->mineRevealed = false;
+        this->clearHistory();
+        this->resize(width, height);
 
-        // Generate mines
-        while (this->mines.size() < mineCount) {
-          unsigned long int minePos = distribution(this->rng);
+        // Above half density it is cheaper to fill the board and pick the safe tiles instead
+        const unsigned long int tileCount = (unsigned long int)width * height;
+        const bool pickSafe = mineCount > tileCount / 2;
+        const unsigned long int pickCount = pickSafe ? tileCount - mineCount : mineCount;
 
-          if (this->mines.insert(minePos).second) {
-            auto [row, col] = intToCoords(width, minePos);
+        // Unless mines are sparse, place them alone and count every tile afterwards, many tiles at a time
+        const bool countAfter = mineCount * BULK_COUNT_RATIO >= tileCount;
 
-            // Set the position as mined
-            try {
-              this->tileAt(row, col).mined = true;
-            } catch (const std::out_of_range&) {
-              this->mines.erase(minePos);
-              continue;
+        if (pickSafe) {
+          for (size_t row = 0; row < height; ++row) {
+            for (size_t col = 0; col < width; ++col) {
+              this->grid[this->index(row, col)].bits |= tile::MINED;
             }
+          }
+        }
 
-            // Increase the count of adjacent mines in adjacent tiles
-            for (int rowOffset = -1; rowOffset <= 1; ++rowOffset) {
-              for (int colOffset = -1; colOffset <= 1; ++colOffset) {
-                if (rowOffset == 0 && colOffset == 0) {
-                  continue;
-                }
+        // Floyd's sampling, using the board itself as the set of picked tiles, so each pick takes exactly one draw
+        for (unsigned long int last = tileCount - pickCount; last < tileCount; ++last) {
+          size_t index = this->positionToIndex(this->rng.below(last + 1));
 
-                try {
-                  ++(this->tileAt(row + rowOffset, col + colOffset).adjacentMines);
-                } catch (const std::out_of_range&) {
-                  continue;
-                }
-              }
-            }
+          if (this->grid[index].isMine() != pickSafe) {
+            index = this->positionToIndex(last);
           }
-        }
-      }
 
-      void reveal(unsigned long int initialPosition) {
-        std::unordered_set<unsigned long int> passedTiles;
+          if (countAfter) {
+            this->grid[index].bits ^= tile::MINED;
+          } else {
+            this->setMine(index, !pickSafe);
+          }
+        }
 
-        // Continue to reveal tiles until there are no more to reveal
-        std::deque<unsigned long int> queuedTiles;
-        queuedTiles.push_front(initialPosition);
-        while (queuedTiles.size() > 0) {
-          unsigned long int position = queuedTiles.front();
-          queuedTiles.pop_front();
+        if (countAfter) {
+          this->countAdjacentMines();
+        }
 
-          if (passedTiles.insert(position).second) {
-            try {
-              auto [row, col] = intToCoords(this->width(), position);
-              tile& t = this->tileAt(row, col);
+        // Nothing has changed on the new board yet
+        this->batching = false;
+        this->startChanges();
+        this->finishChanges();
+      }
 
-              bool wasHidden = t.reveal();
+      const change_set& reveal(unsigned long int position) {
+        // Throws if the position is not on the board
+        const size_t index = this->positionToIndex(position);
+        tile& t = this->grid[index];
 
-              if (wasHidden) {
-                // Regenerate the game if the first reveal is on a mine
-                if (t.mined && this->firstReveal) {
-                  this->initialise(this->width(), this->height(), this->mines.size());
-                  return this->reveal(initialPosition);
-                }
+        this->startChanges();
+        this->startHistory();
 
-                this->firstReveal = false;
-              }
+        if (!t.isFlagged() && !t.isRevealed()) {
+          // Move any mines out of the way of the first reveal
+          if (this->firstReveal) {
+            auto [row, col] = intToCoords(this->width(), position);
+            this->clearFirstReveal(row, col);
+            this->firstReveal = false;
+          }
 
-              // Propogate the revealing to the surrounding tiles
-              if (
-                  // Do not propogate if the tile is a mine or a flag
-                  (!t.mined && !t.flagged) &&
-                  (
-                   // Propogate if the tile is blank
-                   (t.adjacentMines == 0) ||
-                   // Propogate if the number of flags match the number of mines and it is the initial tile and revealed
-                   (position == initialPosition && t.adjacentFlags == t.adjacentMines && !wasHidden)
-                  )
-                 ){
-                for (int rowOffset = -1; rowOffset <= 1; ++rowOffset) {
-                  for (int colOffset = -1; colOffset <= 1; ++colOffset) {
-                    if (rowOffset == 0 && colOffset == 0) {
-                      continue;
-                    }
-
-                    try {
-                      // Check if tile is valid
-                      this->tileAt(row + rowOffset, col + colOffset);
-
-                      // Queue adjacent tile to be revealed
-                      queuedTiles.push_back(coordsToInt(this->width(), {row + rowOffset, col + colOffset}));
-                    } catch (const std::out_of_range&) {
-                      continue;
-                    }
-                  }
-                }
-              }
-            } catch (const std::out_of_range& e) {
-              if (position == initialPosition) {
-                throw e;
-              }
+          this->revealTile(index);
 
-              continue;
-            }
+          if (!t.isMine() && t.adjacentMineCount() == 0) {
+            this->floodFill(index);
           }
+        } else {
+          this->chordTile(index);
         }
+
+        this->recordHistory(action::REVEAL, position);
+        return this->finishChanges();
       }
 
-      void flag(unsigned long int position) {
-        auto [row, col] = intToCoords(this->width(), position);
+      // Reveal the hidden, unflagged neighbours of a revealed tile if it is blank or has as many flags around it as
+      // mines, returning how many tiles were opened. Unlike reveal(), a hidden tile is left alone. The changes made
+      // are in lastChanges().
+      size_t chord(unsigned long int position) {
+        const size_t index = this->positionToIndex(position);
 
-        tile& t = this->tileAt(row, col);
-        if (t.flag()) {
-          // Adjust the adjacent flag count on the grid
-          for (int rowOffset = -1; rowOffset <= 1; ++rowOffset) {
-            for (int colOffset = -1; colOffset <= 1; ++colOffset) {
-              if (rowOffset == 0 && colOffset == 0) {
-                continue;
-              }
+        this->startChanges();
+        this->startHistory();
+        const size_t opened = this->chordTile(index);
+        this->recordHistory(action::CHORD, position);
+        this->finishChanges();
 
-              try {
-                this->tileAt(row + rowOffset, col + colOffset).adjacentFlags += (t.flagged ? 1 : -1);
-              } catch (const std::out_of_range&) {
-                continue;
-              }
-            }
-          }
+        return opened;
+      }
 
-          // Update the flags set
-          if (t.flagged) {
-            this->flags.insert(position);
+      size_t chord(unsigned int row, unsigned int col) {
+        return this->chord(coordsToInt(this->width(), {row, col}));
+      }
+
+      const change_set& flag(unsigned long int position) {
+        const size_t index = this->positionToIndex(position);
+        tile& t = this->grid[index];
+
+        this->startChanges();
+        this->startHistory();
+        if (t.flag()) {
+          // Update the flag count
+          if (t.isFlagged()) {
+            ++this->flaggedTiles;
           } else {
-            this->flags.erase(position);
+            --this->flaggedTiles;
           }
+
+          this->recordChange(index);
         }
+
+        this->recordHistory(action::FLAG, position);
+        return this->finishChanges();
       }
 
-      auto reveal(unsigned int row, unsigned int col) {
+      const change_set& reveal(unsigned int row, unsigned int col) {
         return this->reveal(coordsToInt(this->width(), {row, col}));
       }
 
-      auto flag(unsigned int row, unsigned int col) {
+      const change_set& flag(unsigned int row, unsigned int col) {
         return this->flag(coordsToInt(this->width(), {row, col}));
       }
 
-    private:
-      std::default_random_engine rng;
-      std::vector<std::vector<tile>> grid;
-      std::unordered_set<unsigned long int> mines, flags;
-      bool firstReveal = true;
+      // Collect the changes of every action until commit(), rather than only the latest one
+      void beginBatch() {
+        this->batching = false;
+        this->startChanges();
+        this->batching = true;
+      }
 
-    public:
-      inline size_t width() const {
-        return this->grid.at(0).size();
+      const change_set& commit() {
+        this->batching = false;
+        return this->changes;
       }
 
-      inline size_t height() const {
-        return this->grid.size();
+      // Changes made by the latest action, or by the current batch
+      const change_set& lastChanges() const {
+        return this->changes;
       }
 
-      const std::vector<std::vector<tile>>& getGrid() const {
-        return this->grid;
+      // Whether the first reveal also clears the eight tiles around it, rather than just the tile itself
+      void setSafeOpening(bool enabled) {
+        this->safeOpening = enabled;
       }
 
-      size_t mineCount() const {
-        return this->mines.size();
+      bool hasSafeOpening() const {
+        return this->safeOpening;
       }
 
-      size_t flagCount() const {
-        return this->flags.size();
+      // Whether nothing has been revealed yet, so the mines may still move out of the way
+      bool isFirstReveal() const {
+        return this->firstReveal;
       }
 
-      bool isAllExceptMinesRevealed() const {
-        for (const auto& row : this->grid) {
-          for (const tile& t : row) {
-            if (!t.revealed && !t.mined) {
-              return false;
+      // Keep a history of every action so it can be undone and redone. Each action only keeps the tiles it changed and
+      // where the first reveal moved mines to, so the history grows with the tiles touched rather than the size of
+      // the board. It is off unless asked for, and is neither copied into save files nor kept when turned off.
+      void setUndoHistory(bool enabled) {
+        this->keepHistory = enabled;
+        if (!enabled) {
+          this->clearHistory();
+        }
+      }
+
+      bool hasUndoHistory() const {
+        return this->keepHistory;
+      }
+
+      bool canUndo() const {
+        return this->historyDepth != 0;
+      }
+
+      bool canRedo() const {
+        return this->historyDepth < this->history.size();
+      }
+
+      // Take back the latest action still in effect, putting back any mines the first reveal moved. Returns the
+      // changes, which are empty when there is nothing to undo.
+      const change_set& undo() {
+        this->startChanges();
+        if (!this->canUndo()) {
+          return this->finishChanges();
+        }
+
+        const history_entry& entry = this->history[--this->historyDepth];
+        size_t offset = entry.logStart;
+
+        this->historyMoves.resize(getVarint(this->historyLog, offset));
+        for (auto& [from, to] : this->historyMoves) {
+          from = getVarint(this->historyLog, offset);
+          to = getVarint(this->historyLog, offset);
+        }
+
+        const std::uint8_t bit = entry.type == action::FLAG ? tile::FLAGGED : tile::REVEALED;
+        unsigned long int last = 0;
+        for (std::uint64_t runs = getVarint(this->historyLog, offset); runs != 0; --runs) {
+          const std::uint64_t step = getVarint(this->historyLog, offset);
+          const unsigned long int start = last + unzigzag(step);
+          const size_t length = getVarint(this->historyLog, offset);
+          last = start + length;
+
+          const auto [row, col] = intToCoords(this->width(), start);
+          const size_t first = this->index(row, col);
+          for (size_t i = first; i < first + length; ++i) {
+            this->grid[i].bits ^= bit;
+          }
+          this->recordChange(row, col, length);
+        }
+
+        // Put the mines back in the reverse order they were moved, while the tiles are all hidden again
+        for (auto move = this->historyMoves.rbegin(); move != this->historyMoves.rend(); ++move) {
+          this->setMine(this->positionToIndex(move->second), false);
+          this->setMine(this->positionToIndex(move->first), true);
+        }
+
+        this->revealedSafe = entry.revealedBefore;
+        this->flaggedTiles = entry.flagsBefore;
+        this->mineRevealed = entry.mineRevealedBefore;
+        this->firstReveal = entry.firstRevealBefore;
+        this->rng.restore(this->rng.getKey(), entry.rngCounterBefore);
+
+        return this->finishChanges();
+      }
+
+      // Make the latest undone action again, which does exactly what it did the first time. Returns the changes,
+      // which are empty when there is nothing to redo.
+      const change_set& redo() {
+        if (!this->canRedo()) {
+          this->startChanges();
+          return this->finishChanges();
+        }
+
+        const history_entry& entry = this->history[this->historyDepth];
+        this->redoing = true;
+        switch (entry.type) {
+          case action::FLAG:
+            this->flag(entry.position);
+            break;
+          case action::CHORD:
+            this->chord(entry.position);
+            break;
+          default:
+            this->reveal(entry.position);
+        }
+        this->redoing = false;
+
+        ++this->historyDepth;
+        return this->changes;
+      }
+
+      // Write the board to a file, with the tiles laid out so that load() can map them straight back into memory
+      void save(const std::string& path) const {
+        const size_t tileOffset = (SAVE_HEADER + SAVE_RNG + SAVE_ALIGNMENT - 1) / SAVE_ALIGNMENT * SAVE_ALIGNMENT;
+
+        std::string header(tileOffset, '\0');
+        header.replace(0, SAVE_MAGIC.size(), SAVE_MAGIC);
+        putInt(header, 8, SAVE_VERSION, 4);
+        putInt(header, 12, tileOffset, 4);
+        putInt(header, 16, this->width(), 8);
+        putInt(header, 24, this->height(), 8);
+        putInt(header, 32, this->mineTotal, 8);
+        putInt(header, 40, this->revealedSafe, 8);
+        putInt(header, 48, this->flaggedTiles, 8);
+        putInt(header, 56, this->firstReveal | this->safeOpening << 1 | this->mineRevealed << 2, 4);
+        putInt(header, 60, SAVE_RNG, 4);
+        putInt(header, SAVE_HEADER, this->rng.getKey(), 8);
+        putInt(header, SAVE_HEADER + 8, this->rng.getCounter(), 8);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+          throw std::runtime_error("Could not open save file for writing.");
+        }
+
+        file.write(header.data(), header.size());
+        file.write(reinterpret_cast<const char*>(this->grid.data()), this->grid.size());
+        if (!file) {
+          throw std::runtime_error("Could not write save file.");
+        }
+      }
+
+      // Open a board written by save(). The tiles are mapped copy-on-write rather than read, so only the pages that
+      // are touched get read and playing on never changes the file. Only the header and the border around the board
+      // are checked, which is enough to keep the game inside the grid. With verify, every tile is read through as well
+      // to check that they make a board the game could have reached, which costs time in proportion to its size.
+      static basic_game load(const std::string& path, bool verify = false) {
+        struct descriptor {
+          int fd;
+
+          ~descriptor() {
+            if (this->fd >= 0) {
+              close(this->fd);
             }
           }
+        } file{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+
+        struct stat info;
+        if (file.fd < 0 || fstat(file.fd, &info) != 0) {
+          throw std::runtime_error("Could not open save file.");
+        }
+
+        std::string header(SAVE_HEADER + SAVE_RNG, '\0');
+        if (pread(file.fd, header.data(), header.size(), 0) != (ssize_t)header.size() || header.compare(0, SAVE_MAGIC.size(), SAVE_MAGIC) != 0) {
+          throw std::runtime_error("Not a save file.");
+        }
+        if (getInt(header, 8, 4) != SAVE_VERSION) {
+          throw std::runtime_error("Unsupported save file version.");
+        }
+
+        basic_game g;
+        const size_t tileOffset = getInt(header, 12, 4);
+        const size_t rngLength = getInt(header, 60, 4);
+        const size_t width = getInt(header, 16, 8), height = getInt(header, 24, 8);
+        g.mineTotal = getInt(header, 32, 8);
+        g.revealedSafe = getInt(header, 40, 8);
+        g.flaggedTiles = getInt(header, 48, 8);
+
+        const std::uint64_t flags = getInt(header, 56, 4);
+        g.firstReveal = flags & 1;
+        g.safeOpening = flags & 2;
+        g.mineRevealed = flags & 4;
+
+        const size_t tileCount = (width + 2) * (height + 2);
+        if (width == 0 || height == 0 || width > UINT32_MAX || height > UINT32_MAX ||
+            g.mineTotal > width * height || g.revealedSafe > width * height - g.mineTotal ||
+            g.flaggedTiles > width * height - g.revealedSafe ||
+            rngLength != SAVE_RNG || tileOffset < SAVE_HEADER + SAVE_RNG || tileOffset % SAVE_ALIGNMENT != 0 ||
+            (size_t)info.st_size != tileOffset + tileCount) {
+          throw std::runtime_error("Save file is damaged.");
+        }
+
+        if constexpr (FIXED) {
+          if (width != W || height != H) {
+            throw std::runtime_error("Save file is for another size of board.");
+          }
+        } else {
+          g.gridWidth = width;
+          g.gridHeight = height;
+          g.gridStride = width + 2;
+        }
+
+        g.rng.restore(getInt(header, SAVE_HEADER, 8), getInt(header, SAVE_HEADER + 8, 8));
+
+        // Fixed size games hold their own tiles, so only runtime sized ones can map them. Mapping also needs the tiles
+        // to start on a page, which they will unless pages are larger than the alignment.
+        if constexpr (FIXED) {
+          if (pread(file.fd, g.grid.data(), tileCount, tileOffset) != (ssize_t)tileCount) {
+            throw std::runtime_error("Could not read save file.");
+          }
+        } else if (tileOffset % sysconf(_SC_PAGESIZE) == 0) {
+          void* mapped = mmap(nullptr, tileCount, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.fd, tileOffset);
+          if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Could not map save file.");
+          }
+
+          g.grid.map(static_cast<tile*>(mapped), tileCount, std::shared_ptr<void>(mapped, [tileCount](void* p) {
+            munmap(p, tileCount);
+          }));
+        } else {
+          g.grid.assign(tileCount, tile());
+          if (pread(file.fd, g.grid.data(), tileCount, tileOffset) != (ssize_t)tileCount) {
+            throw std::runtime_error("Could not read save file.");
+          }
+        }
+
+        g.setNeighbourOffsets();
+        if (!g.hasBorder() || (verify && !g.hasConsistentTiles())) {
+          throw std::runtime_error("Save file is damaged.");
+        }
+        g.fillStack.reserve(width + height);
+        g.startChanges();
+        g.finishChanges();
+        return g;
+      }
+
+      // Count the flags surrounding a tile, used to decide whether a revealed tile may be chorded
+      unsigned short int adjacentFlagCount(size_t row, size_t col) const {
+        return this->adjacentFlagCount(this->index(row, col));
+      }
+
+      // Call function(row, col) for every neighbour of a tile that lies on the board
+      template<typename Function>
+      void forEachNeighbour(size_t row, size_t col, Function&& function) const {
+        const size_t centre = this->index(row, col);
+
+        for (const auto& [rowOffset, colOffset] : NEIGHBOURS) {
+          if (!(this->grid[centre + rowOffset * (std::ptrdiff_t)this->stride() + colOffset].bits & tile::BORDER)) {
+            function(row + rowOffset, col + colOffset);
+          }
         }
+      }
+
+    private:
+      // Save file layout: a fixed header, the random number generator's state, then the padded grid from a page boundary
+      static constexpr std::string_view SAVE_MAGIC = "MINESWPR";
+      static constexpr std::uint32_t SAVE_VERSION = 2;
+      static constexpr size_t SAVE_HEADER = 64;
+      // The generator's key and counter
+      static constexpr size_t SAVE_RNG = 16;
+      static constexpr size_t SAVE_ALIGNMENT = 4096;
+
+      // Boards with at least one mine in this many tiles are counted in one pass after the mines are placed. Filling
+      // the board for more than half density relies on that pass, so this must be at least 2.
+      static constexpr unsigned long int BULK_COUNT_RATIO = 32;
+      static_assert(BULK_COUNT_RATIO >= 2);
+      // Fewest tiles worth counting with AVX2 rather than SSE2
+      static constexpr size_t AVX2_COUNT_MIN = 1024;
+      // Tiles a flood fill reveals on its own before it carries on across every core
+      static constexpr size_t PARALLEL_FILL_THRESHOLD = 1 << 18;
+      // Rows in each band of a parallel flood fill
+      static constexpr size_t PARALLEL_BAND = 64;
+
+      // What a pass over the tiles of a loaded board found
+      struct tile_census {
+        size_t mines = 0, flags = 0, revealed = 0, minesRevealed = 0, borders = 0;
+        bool damaged = false;
+      };
+
+      // Whether tiles loaded from a file have a border all the way round, which is what keeps every walk over
+      // neighbours inside the grid. Only the first and last rows and the ends of the others are read.
+      bool hasBorder() const {
+        const std::uint8_t* tiles = reinterpret_cast<const std::uint8_t*>(this->grid.data());
+        const size_t width = this->width(), height = this->height(), stride = this->stride();
+
+        // Border tiles may count the mines next to them, of which there are at most three
+        const auto isBorder = [](std::uint8_t bits) {
+          return (bits & ~tile::ADJACENT) == tile::BORDER && (bits & tile::ADJACENT) <= 3;
+        };
 
-        return !this->isMineRevealed();
+        for (size_t col = 0; col < stride; ++col) {
+          if (!isBorder(tiles[col]) || !isBorder(tiles[(height + 1) * stride + col])) {
+            return false;
+          }
+        }
+        for (size_t row = 1; row <= height; ++row) {
+          if (!isBorder(tiles[row * stride]) || !isBorder(tiles[row * stride + width + 1])) {
+            return false;
+          }
+        }
+        return true;
       }
 
-      bool isMineRevealed() const {
-        for (const auto& position : mines) {
-          auto [row, col] = intToCoords(this->width(), position);
+      // Whether the tiles inside a border make a board the game could have reached: nothing on the board claiming to
+      // be border, no revealed flags, counts that match the mines around them, and totals and state that match the
+      // header
+      bool hasConsistentTiles() const {
+        const std::uint8_t* tiles = reinterpret_cast<const std::uint8_t*>(this->grid.data());
+        const size_t width = this->width(), height = this->height();
+
+        // Check the board as one span, as countAdjacentMines() counts it. The borders at the ends of the rows within
+        // it are only counted, and there being no more of them than there should be means no other tile is one.
+        const size_t first = this->index(0, 0), end = this->index(height - 1, width - 1) + 1;
+        tile_census census;
+        size_t next = first;
+#if defined(__x86_64__) && defined(__GNUC__)
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        if (avx2 && end - first >= AVX2_COUNT_MIN) {
+          next = checkSpanAvx2(tiles, next, end, this->offsets(), census);
+        }
+        next = checkSpanSse2(tiles, next, end, this->offsets(), census);
+#endif
+        for (; next < end; ++next) {
+          const std::uint8_t bits = tiles[next];
+          if (bits & tile::BORDER) {
+            ++census.borders;
+            continue;
+          }
 
-          if (this->tileAt(row, col).revealed) {
-            return true;
+          std::uint8_t count = 0;
+          for (std::ptrdiff_t offset : this->offsets()) {
+            count += (tiles[next + offset] & tile::MINED) >> 6;
           }
+
+          const bool mined = bits & tile::MINED, shown = bits & tile::REVEALED;
+          census.damaged |= (bits & tile::ADJACENT) != count || (shown && (bits & tile::FLAGGED));
+          census.mines += mined;
+          census.flags += (bits & tile::FLAGGED) != 0;
+          census.revealed += shown && !mined;
+          census.minesRevealed += shown && mined;
         }
 
-        return false;
+        // Nothing is revealed before the first reveal
+        return !census.damaged && census.borders == 2 * (height - 1) && census.mines == this->mineTotal &&
+          census.flags == this->flaggedTiles && census.revealed == this->revealedSafe &&
+          (census.minesRevealed != 0) == this->mineRevealed &&
+          (!this->firstReveal || census.revealed + census.minesRevealed == 0);
       }
-  };
+
+#if defined(__x86_64__) && defined(__GNUC__)
+      // Check 32 tiles at a time from next, returning where it stopped. Each bit is shifted up to the top of its byte to
+      // be gathered into a mask of the tiles that have it.
+      [[gnu::target("avx2,popcnt")]]
+      static size_t checkSpanAvx2(const std::uint8_t* tiles, size_t next, size_t end, const std::array<std::ptrdiff_t, 8>& offsets,
+          tile_census& census) {
+        const __m256i adjacent = _mm256_set1_epi8(tile::ADJACENT);
+        unsigned int damaged = 0;
+
+        for (; next + 32 <= end; next += 32) {
+          const __m256i count = minesAroundAvx2(tiles, next, offsets);
+          const __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tiles + next));
+          const unsigned int border = _mm256_movemask_epi8(bits);
+          const unsigned int mines = _mm256_movemask_epi8(_mm256_slli_epi16(bits, 1)) & ~border;
+          const unsigned int flags = _mm256_movemask_epi8(_mm256_slli_epi16(bits, 2)) & ~border;
+          const unsigned int shown = _mm256_movemask_epi8(_mm256_slli_epi16(bits, 3)) & ~border;
+          const unsigned int counted = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(bits, adjacent), count));
+
+          damaged |= (~counted & ~border) | (shown & flags);
+          census.mines += __builtin_popcount(mines);
+          census.flags += __builtin_popcount(flags);
+          census.revealed += __builtin_popcount(shown & ~mines);
+          census.minesRevealed += __builtin_popcount(shown & mines);
+          census.borders += __builtin_popcount(border);
+        }
+
+        census.damaged |= damaged != 0;
+        return next;
+      }
+
+      // Check 16 tiles at a time, with the SSE2 instructions every x86-64 processor has
+      static size_t checkSpanSse2(const std::uint8_t* tiles, size_t next, size_t end, const std::array<std::ptrdiff_t, 8>& offsets,
+          tile_census& census) {
+        const __m128i adjacent = _mm_set1_epi8(tile::ADJACENT);
+        unsigned int damaged = 0;
+
+        for (; next + 16 <= end; next += 16) {
+          const __m128i count = minesAroundSse2(tiles, next, offsets);
+          const __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tiles + next));
+          const unsigned int border = _mm_movemask_epi8(bits);
+          const unsigned int onBoard = ~border & 0xffff;
+          const unsigned int mines = _mm_movemask_epi8(_mm_slli_epi16(bits, 1)) & onBoard;
+          const unsigned int flags = _mm_movemask_epi8(_mm_slli_epi16(bits, 2)) & onBoard;
+          const unsigned int shown = _mm_movemask_epi8(_mm_slli_epi16(bits, 3)) & onBoard;
+          const unsigned int counted = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(bits, adjacent), count));
+
+          damaged |= (~counted & onBoard) | (shown & flags);
+          census.mines += __builtin_popcount(mines);
+          census.flags += __builtin_popcount(flags);
+          census.revealed += __builtin_popcount(shown & ~mines);
+          census.minesRevealed += __builtin_popcount(shown & mines);
+          census.borders += __builtin_popcount(border);
+        }
+
+        census.damaged |= damaged != 0;
+        return next;
+      }
+#endif
+
+      // Little-endian fields, so save files can move between machines
+      static void putInt(std::string& out, size_t offset, std::uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) {
+          out[offset + i] = (char)(value >> (8 * i));
+        }
+      }
+
+      static std::uint64_t getInt(const std::string& in, size_t offset, size_t bytes) {
+        std::uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+          value |= (std::uint64_t)(unsigned char)in[offset + i] << (8 * i);
+        }
+        return value;
+      }
+
+      // Only for load(), which fills everything in itself
+      basic_game() {}
+
+      // The grid is padded by a ring of border tiles, so every tile on the board has eight valid neighbours
+      void resize(size_t width, size_t height) {
+        if constexpr (!FIXED) {
+          this->gridWidth = width;
+          this->gridHeight = height;
+          this->gridStride = width + 2;
+        }
+        this->grid.assign(this->stride() * (height + 2), tile());
+        this->fillStack.reserve(width + height);
+
+        tile border;
+        border.bits = tile::BORDER;
+        std::fill_n(this->grid.begin(), this->stride(), border);
+        std::fill_n(this->grid.end() - this->stride(), this->stride(), border);
+        for (size_t row = 1; row <= height; ++row) {
+          this->grid[row * this->stride()] = border;
+          this->grid[row * this->stride() + width + 1] = border;
+        }
+
+        this->setNeighbourOffsets();
+      }
+
+      void setNeighbourOffsets() {
+        if constexpr (!FIXED) {
+          this->neighbourOffsets = offsetsFor(this->gridStride);
+        }
+      }
+
+      static constexpr std::array<std::ptrdiff_t, 8> offsetsFor(std::ptrdiff_t stride) {
+        std::array<std::ptrdiff_t, 8> table;
+        for (size_t i = 0; i < NEIGHBOURS.size(); ++i) {
+          table[i] = NEIGHBOURS[i].first * stride + NEIGHBOURS[i].second;
+        }
+        return table;
+      }
+
+      inline size_t stride() const {
+        if constexpr (FIXED) {
+          return W + 2;
+        } else {
+          return this->gridStride;
+        }
+      }
+
+      // Offsets of the eight surrounding tiles in the padded grid
+      inline const std::array<std::ptrdiff_t, 8>& offsets() const {
+        if constexpr (FIXED) {
+          static constexpr std::array<std::ptrdiff_t, 8> fixedOffsets = offsetsFor(W + 2);
+          return fixedOffsets;
+        } else {
+          return this->neighbourOffsets;
+        }
+      }
+
+      inline size_t index(size_t row, size_t col) const {
+        return (row + 1) * this->stride() + col + 1;
+      }
+
+      size_t positionToIndex(unsigned long int position) const {
+        auto [row, col] = intToCoords(this->width(), position);
+        if (row >= this->height()) {
+          throw std::out_of_range("Tile position is outside of the game board.");
+        }
+
+        return this->index(row, col);
+      }
+
+      // Call function(index) for every neighbour of the tile at index that lies on the board
+      template<typename Function>
+      inline void forEachNeighbourIndex(size_t index, Function&& function) {
+        for (std::ptrdiff_t offset : this->offsets()) {
+          const size_t neighbour = index + offset;
+
+          if (!(this->grid[neighbour].bits & tile::BORDER)) {
+            function(neighbour);
+          }
+        }
+      }
+
+      // Add or remove a mine and adjust the adjacent mine counts around it
+      void setMine(size_t index, bool mined) {
+        if (mined) {
+          this->grid[index].bits |= tile::MINED;
+        } else {
+          this->grid[index].bits &= ~tile::MINED;
+        }
+
+        // Border tiles are counted too, which saves a branch per neighbour. Their counts are never read, and at most
+        // three tiles on the board touch any one of them, so the count cannot reach the flag bits. Boards counted in
+        // bulk leave them at zero, so a count is never taken below that.
+        for (std::ptrdiff_t offset : this->offsets()) {
+          std::uint8_t& bits = this->grid[index + offset].bits;
+          if (mined) {
+            ++bits;
+          } else {
+            bits -= (bits & tile::ADJACENT) != 0;
+          }
+        }
+      }
+
+      // Count the mines around every tile on the board, for boards dealt without counting as they went. The rows run
+      // together as one span, with the border tiles between them left alone, so even narrow boards are counted many
+      // tiles at a time.
+      void countAdjacentMines() {
+        std::uint8_t* tiles = reinterpret_cast<std::uint8_t*>(this->grid.data());
+        const size_t first = this->index(0, 0), end = this->index(this->height() - 1, this->width() - 1) + 1;
+
+        size_t next = first;
+#if defined(__x86_64__) && defined(__GNUC__)
+        // Switching between AVX and SSE code costs more than it saves on small boards
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        if (avx2 && end - first >= AVX2_COUNT_MIN) {
+          next = countSpanAvx2(tiles, next, end, this->offsets());
+        }
+        next = countSpanSse2(tiles, next, end, this->offsets());
+
+        // Counting only reads the mines, so the last few tiles can be counted again as part of a whole vector
+        if (next < end && end - first >= 16) {
+          next = countSpanSse2(tiles, end - 16, end, this->offsets());
+        }
+#endif
+        for (; next < end; ++next) {
+          if (tiles[next] & tile::BORDER) {
+            continue;
+          }
+
+          std::uint8_t count = 0;
+          for (std::ptrdiff_t offset : this->offsets()) {
+            count += (tiles[next + offset] & tile::MINED) >> 6;
+          }
+          tiles[next] = (tiles[next] & ~tile::ADJACENT) | count;
+        }
+      }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+      // The mines around each of the 32 tiles from next. A mined neighbour compares equal to 0xff, which is -1, so
+      // subtracting the comparisons adds up the mines.
+      [[gnu::target("avx2"), gnu::always_inline]]
+      static __m256i minesAroundAvx2(const std::uint8_t* tiles, size_t next, const std::array<std::ptrdiff_t, 8>& offsets) {
+        const __m256i mined = _mm256_set1_epi8(tile::MINED);
+        __m256i count = _mm256_setzero_si256();
+        for (std::ptrdiff_t offset : offsets) {
+          const __m256i neighbours = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tiles + next + offset));
+          count = _mm256_sub_epi8(count, _mm256_cmpeq_epi8(_mm256_and_si256(neighbours, mined), mined));
+        }
+        return count;
+      }
+
+      // The same for the 16 tiles from next
+      [[gnu::always_inline]]
+      static __m128i minesAroundSse2(const std::uint8_t* tiles, size_t next, const std::array<std::ptrdiff_t, 8>& offsets) {
+        const __m128i mined = _mm_set1_epi8(tile::MINED);
+        __m128i count = _mm_setzero_si128();
+        for (std::ptrdiff_t offset : offsets) {
+          const __m128i neighbours = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tiles + next + offset));
+          count = _mm_sub_epi8(count, _mm_cmpeq_epi8(_mm_and_si128(neighbours, mined), mined));
+        }
+        return count;
+      }
+
+      // Count 32 tiles at a time from next, returning where it stopped. Border tiles are the only ones with the top
+      // bit set, so they compare below zero and keep their bits.
+      [[gnu::target("avx2")]]
+      static size_t countSpanAvx2(std::uint8_t* tiles, size_t next, size_t end, const std::array<std::ptrdiff_t, 8>& offsets) {
+        const __m256i keep = _mm256_set1_epi8(~tile::ADJACENT);
+        const __m256i zero = _mm256_setzero_si256();
+
+        for (; next + 32 <= end; next += 32) {
+          __m256i count = minesAroundAvx2(tiles, next, offsets);
+          __m256i* target = reinterpret_cast<__m256i*>(tiles + next);
+          const __m256i bits = _mm256_loadu_si256(target);
+          count = _mm256_andnot_si256(_mm256_cmpgt_epi8(zero, bits), count);
+          _mm256_storeu_si256(target, _mm256_or_si256(_mm256_and_si256(bits, keep), count));
+        }
+
+        return next;
+      }
+
+      // The same, 16 tiles at a time, which every x86-64 processor can do
+      static size_t countSpanSse2(std::uint8_t* tiles, size_t next, size_t end, const std::array<std::ptrdiff_t, 8>& offsets) {
+        const __m128i keep = _mm_set1_epi8(~tile::ADJACENT);
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; next + 16 <= end; next += 16) {
+          __m128i count = minesAroundSse2(tiles, next, offsets);
+          __m128i* target = reinterpret_cast<__m128i*>(tiles + next);
+          const __m128i bits = _mm_loadu_si128(target);
+          count = _mm_andnot_si128(_mm_cmplt_epi8(bits, zero), count);
+          _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(bits, keep), count));
+        }
+
+        return next;
+      }
+#endif
+
+      // Relocate the mines under the first reveal (and its surroundings, for a safe opening) to random tiles elsewhere.
+      // Only the moved mines' neighbours are touched, so this costs the same on any size of board.
+      void clearFirstReveal(size_t row, size_t col) {
+        const unsigned long int tileCount = this->width() * this->height();
+
+        size_t radius = this->safeOpening ? 1 : 0;
+        size_t rowMin, rowMax, colMin, colMax;
+        while (true) {
+          rowMin = row > radius ? row - radius : 0;
+          colMin = col > radius ? col - radius : 0;
+          rowMax = std::min(row + radius, this->height() - 1);
+          colMax = std::min(col + radius, this->width() - 1);
+
+          // Shrink the cleared area if the rest of the board cannot hold every mine
+          if (this->mineTotal + (rowMax - rowMin + 1) * (colMax - colMin + 1) <= tileCount) {
+            break;
+          } else if (radius == 0) {
+            return;
+          }
+
+          --radius;
+        }
+
+        const auto isFree = [&](unsigned long int position) {
+          auto [r, c] = intToCoords(this->width(), position);
+          bool cleared = r >= rowMin && r <= rowMax && c >= colMin && c <= colMax;
+          return !cleared && !this->grid[this->index(r, c)].isMine();
+        };
+
+        for (size_t r = rowMin; r <= rowMax; ++r) {
+          for (size_t c = colMin; c <= colMax; ++c) {
+            if (!this->grid[this->index(r, c)].isMine()) {
+              continue;
+            }
+
+            // Try a few random tiles, then fall back to walking the board from the last one
+            unsigned long int target = this->rng.below(tileCount);
+            for (int attempt = 1; !isFree(target); ++attempt) {
+              target = attempt < 32 ? this->rng.below(tileCount) : (target + 1) % tileCount;
+            }
+
+            this->setMine(this->index(r, c), false);
+            this->setMine(this->positionToIndex(target), true);
+            if (this->isRecordingHistory()) {
+              this->historyMoves.emplace_back(coordsToInt(this->width(), {r, c}), target);
+            }
+          }
+        }
+      }
+
+      // Reveal a single tile and keep the win/loss counters up to date, returning true if it was hidden
+      bool revealTile(size_t index) {
+        tile& t = this->grid[index];
+        if (!t.reveal()) {
+          return false;
+        }
+
+        this->recordChange(index);
+
+        if (t.isMine()) {
+          this->mineRevealed = true;
+        } else {
+          ++this->revealedSafe;
+        }
+
+        return true;
+      }
+
+      // What an action undone from the history does again
+      enum struct action : std::uint8_t {
+        REVEAL,
+        FLAG,
+        CHORD
+      };
+
+      // An action in the history, whose changed tiles and moved mines are in the log from logStart
+      struct history_entry {
+        action type = action::REVEAL;
+        unsigned long int position = 0;
+        size_t logStart = 0;
+        size_t revealedBefore = 0, flagsBefore = 0;
+        std::uint64_t rngCounterBefore = 0;
+        bool mineRevealedBefore = false, firstRevealBefore = false;
+      };
+
+      bool isRecordingHistory() const {
+        return this->keepHistory && !this->redoing;
+      }
+
+      void clearHistory() {
+        this->history.clear();
+        this->historyLog.clear();
+        this->historyDepth = 0;
+      }
+
+      // Note the state before an action, and where its changes start among those of the rest of a batch
+      void startHistory() {
+        if (!this->isRecordingHistory()) {
+          return;
+        }
+
+        const auto& runs = this->changes.changed;
+        this->historyRun = runs.size();
+        this->historyRunLength = runs.empty() ? 0 : runs.back().length;
+        this->historyMoves.clear();
+
+        history_entry& entry = this->pendingEntry;
+        entry.revealedBefore = this->revealedSafe;
+        entry.flagsBefore = this->flaggedTiles;
+        entry.rngCounterBefore = this->rng.getCounter();
+        entry.mineRevealedBefore = this->mineRevealed;
+        entry.firstRevealBefore = this->firstReveal;
+      }
+
+      // Append an action that changed something to the history, in place of any actions that had been undone. Its
+      // runs are stored as varints of how far each starts from the end of the one before, and its length, so most
+      // take two bytes.
+      void recordHistory(action type, unsigned long int position) {
+        if (!this->isRecordingHistory()) {
+          return;
+        }
+
+        // Within a batch the action's first tiles may have been merged into the run before them
+        const auto& runs = this->changes.changed;
+        const size_t grown = this->historyRun == 0 ? 0 : runs[this->historyRun - 1].length - this->historyRunLength;
+        if (grown == 0 && runs.size() == this->historyRun) {
+          return;
+        }
+
+        if (this->canRedo()) {
+          this->historyLog.resize(this->history[this->historyDepth].logStart);
+          this->history.resize(this->historyDepth);
+        }
+
+        history_entry& entry = this->pendingEntry;
+        entry.type = type;
+        entry.position = position;
+        entry.logStart = this->historyLog.size();
+
+        putVarint(this->historyLog, this->historyMoves.size());
+        for (const auto& [from, to] : this->historyMoves) {
+          putVarint(this->historyLog, from);
+          putVarint(this->historyLog, to);
+        }
+
+        unsigned long int last = 0;
+        const auto putRun = [this, &last](size_t row, size_t col, size_t length) {
+          const unsigned long int start = coordsToInt(this->width(), {row, col});
+          putVarint(this->historyLog, zigzag((std::int64_t)(start - last)));
+          putVarint(this->historyLog, length);
+          last = start + length;
+        };
+
+        putVarint(this->historyLog, runs.size() - this->historyRun + (grown != 0));
+        if (grown != 0) {
+          const auto& merged = runs[this->historyRun - 1];
+          putRun(merged.row, merged.col + this->historyRunLength, grown);
+        }
+        for (size_t i = this->historyRun; i < runs.size(); ++i) {
+          putRun(runs[i].row, runs[i].col, runs[i].length);
+        }
+
+        this->history.push_back(entry);
+        ++this->historyDepth;
+      }
+
+      // Start recording the changes of an action, unless it is part of a batch
+      void startChanges() {
+        if (!this->batching) {
+          this->changes.changed.clear();
+          this->changes.revealedBefore = this->revealedSafe;
+          this->changes.flagsBefore = this->flaggedTiles;
+          this->changes.stateBefore = this->state();
+        }
+      }
+
+      const change_set& finishChanges() {
+        this->changes.revealedAfter = this->revealedSafe;
+        this->changes.flagsAfter = this->flaggedTiles;
+        this->changes.stateAfter = this->state();
+        return this->changes;
+      }
+
+      // Append a run of changed tiles, merging it into the previous run where they touch
+      static void appendRun(std::vector<change_set::run>& runs, size_t row, size_t col, size_t length) {
+        if (length == 0) {
+          return;
+        }
+
+        if (!runs.empty() && runs.back().row == row && runs.back().col + runs.back().length == col) {
+          runs.back().length += length;
+        } else {
+          runs.push_back({row, col, length});
+        }
+      }
+
+      void recordChange(size_t row, size_t col, size_t length) {
+        appendRun(this->changes.changed, row, col, length);
+      }
+
+      void recordChange(size_t index) {
+        this->recordChange(index / this->stride() - 1, index % this->stride() - 1, 1);
+      }
+
+      // Hidden, unflagged, blank tiles which a flood fill may pass through
+      static inline bool isHiddenBlank(std::uint8_t bits) {
+        return (bits & (tile::ADJACENT | tile::REVEALED | tile::FLAGGED | tile::MINED | tile::BORDER)) == 0;
+      }
+
+      static inline bool isHiddenBlank(const tile& t) {
+        return isHiddenBlank(t.bits);
+      }
+
+      // Reveal the area surrounding an already revealed blank tile, one horizontal span at a time.
+      // Every index on the stack is a revealed blank tile whose span has not been scanned yet.
+      void floodFill(size_t seed) {
+        constexpr std::uint8_t SKIP = tile::REVEALED | tile::FLAGGED | tile::BORDER;
+        size_t revealed = 0;
+
+        this->fillStack.clear();
+        this->fillStack.push_back(seed);
+        while (!this->fillStack.empty()) {
+          // Fixed boards are never large enough to need the other cores
+          if constexpr (!FIXED) {
+            static const unsigned int threadCount = std::thread::hardware_concurrency();
+            if (revealed >= PARALLEL_FILL_THRESHOLD && threadCount > 1) {
+              revealed += this->parallelFloodFill(threadCount);
+              break;
+            }
+          }
+
+          const size_t start = this->fillStack.back();
+          size_t left = start, right = start;
+          this->fillStack.pop_back();
+
+          const size_t row = start / this->stride() - 1;
+          const size_t rowBase = this->index(row, 0);
+
+          // Extend the span across the hidden blank tiles either side
+          while (isHiddenBlank(this->grid[left - 1])) {
+            this->grid[--left].bits |= tile::REVEALED;
+          }
+          while (isHiddenBlank(this->grid[right + 1])) {
+            this->grid[++right].bits |= tile::REVEALED;
+          }
+          revealed += right - left;
+          this->recordChange(row, left - rowBase, start - left);
+          this->recordChange(row, start + 1 - rowBase, right - start);
+
+          // The tiles at either end of the span can only be numbers by now
+          for (size_t end : {left - 1, right + 1}) {
+            if (!(this->grid[end].bits & SKIP)) {
+              this->grid[end].bits |= tile::REVEALED;
+              this->recordChange(row, end - rowBase, 1);
+              ++revealed;
+            }
+          }
+
+          // Reveal the rows above and below the span, seeding each run of blank tiles once.
+          // The rest of a run is picked up when its seed's span is extended.
+          for (auto [scanRow, rowStart] : {std::pair{row - 1, left - 1 - this->stride()}, std::pair{row + 1, left - 1 + this->stride()}}) {
+            bool inRun = false;
+
+            for (size_t i = rowStart; i <= rowStart + (right - left) + 2; ++i) {
+              tile& t = this->grid[i];
+
+              if (t.bits & SKIP) {
+                inRun = false;
+                continue;
+              } else if (t.adjacentMineCount() != 0) {
+                inRun = false;
+              } else if (!inRun) {
+                this->fillStack.push_back(i);
+                inRun = true;
+              } else {
+                continue;
+              }
+
+              t.bits |= tile::REVEALED;
+              this->recordChange(scanRow, left - 1 - rowBase + (i - rowStart), 1);
+              ++revealed;
+            }
+          }
+        }
+
+        // None of the tiles a flood fill reaches can be mines
+        this->revealedSafe += revealed;
+      }
+
+      // Chord the tile at index if it can be chorded, returning how many tiles were opened
+      size_t chordTile(size_t index) {
+        const tile& t = this->grid[index];
+        if (!t.isRevealed() || t.isMine() ||
+            (t.adjacentMineCount() != 0 && this->adjacentFlagCount(index) != t.adjacentMineCount())) {
+          return 0;
+        }
+
+        const size_t before = this->revealedSafe;
+        size_t minesOpened = 0;
+
+        // Only a blank neighbour needs the flood fill
+        this->forEachNeighbourIndex(index, [this, &minesOpened](size_t neighbour) {
+          const tile& n = this->grid[neighbour];
+
+          if (this->revealTile(neighbour)) {
+            if (n.isMine()) {
+              ++minesOpened;
+            } else if (n.adjacentMineCount() == 0) {
+              this->floodFill(neighbour);
+            }
+          }
+        });
+
+        return this->revealedSafe - before + minesOpened;
+      }
+
+      // Carry on a flood fill from the tiles left on the fill stack across several threads, returning how many tiles
+      // were revealed. The board is split into bands of rows, and each band is filled by one thread at a time, which
+      // hands the seeds it finds in other bands to whichever thread takes them up. Only the rows along the edge of a
+      // band are also reached from the band next to it, so only their tiles are claimed with atomic operations, and
+      // whichever thread sets a tile's revealed bit first owns it.
+      size_t parallelFloodFill(unsigned int threadCount) {
+        constexpr std::uint8_t SKIP = tile::REVEALED | tile::FLAGGED | tile::BORDER;
+        std::uint8_t* tiles = reinterpret_cast<std::uint8_t*>(this->grid.data());
+        const size_t stride = this->stride();
+
+        struct band {
+          std::vector<size_t> inbox;
+          bool busy = false, queued = false;
+        };
+        std::vector<band> bands((this->height() + PARALLEL_BAND - 1) / PARALLEL_BAND);
+        const auto bandOf = [stride](size_t index) {
+          return (index / stride - 1) / PARALLEL_BAND;
+        };
+
+        struct worker {
+          std::vector<size_t> stack, outgoing;
+          std::vector<change_set::run> runs;
+          size_t revealed = 0;
+        };
+        std::vector<worker> workers(threadCount);
+        // This thread's runs go straight into the change set, so the biggest share keeps its memory between fills
+        workers[0].runs.swap(this->changes.changed);
+
+        // Everything below is guarded by the lock, except the tiles and the count of waiting threads
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<size_t> ready;
+        std::atomic<unsigned int> waiting = 0;
+        unsigned int active = 0;
+
+        // Hand seeds to their bands, queueing any band that nobody is filling
+        const auto deliver = [&](std::vector<size_t>& seeds) {
+          for (size_t seed : seeds) {
+            band& b = bands[bandOf(seed)];
+            b.inbox.push_back(seed);
+            if (!b.busy && !b.queued) {
+              b.queued = true;
+              ready.push_back(&b - bands.data());
+            }
+          }
+          seeds.clear();
+          wake.notify_all();
+        };
+        deliver(this->fillStack);
+
+        const auto isEdge = [](size_t row) {
+          return row % PARALLEL_BAND == 0 || row % PARALLEL_BAND == PARALLEL_BAND - 1;
+        };
+        const auto load = [tiles](size_t i, bool edge) -> std::uint8_t {
+          return edge ? std::atomic_ref<std::uint8_t>(tiles[i]).load(std::memory_order_relaxed) : tiles[i];
+        };
+        // Returns whether this thread was the one to reveal the tile
+        const auto claim = [tiles](size_t i, bool edge) {
+          if (edge) {
+            return !(std::atomic_ref<std::uint8_t>(tiles[i]).fetch_or(tile::REVEALED, std::memory_order_relaxed) & tile::REVEALED);
+          }
+
+          const bool hidden = !(tiles[i] & tile::REVEALED);
+          tiles[i] |= tile::REVEALED;
+          return hidden;
+        };
+
+        // The same as the serial fill, except that a span may stop at a tile another thread revealed, which that
+        // thread carries on from. A run whose first tile another thread revealed is also being extended by it.
+        const auto fill = [&](worker& w, size_t current, size_t start) {
+          const size_t row = start / stride - 1;
+          const size_t rowBase = this->index(row, 0);
+          const bool edge = isEdge(row);
+
+          size_t left = start, right = start;
+          while (isHiddenBlank(load(left - 1, edge)) && claim(left - 1, edge)) {
+            --left;
+          }
+          while (isHiddenBlank(load(right + 1, edge)) && claim(right + 1, edge)) {
+            ++right;
+          }
+          w.revealed += right - left;
+          appendRun(w.runs, row, left - rowBase, start - left);
+          appendRun(w.runs, row, start + 1 - rowBase, right - start);
+
+          for (size_t end : {left - 1, right + 1}) {
+            if (!(load(end, edge) & SKIP) && claim(end, edge)) {
+              appendRun(w.runs, row, end - rowBase, 1);
+              ++w.revealed;
+            }
+          }
+
+          for (auto [scanRow, rowStart] : {std::pair{row - 1, left - 1 - stride}, std::pair{row + 1, left - 1 + stride}}) {
+            const bool scanEdge = isEdge(scanRow);
+            std::vector<size_t>& seeds = scanRow / PARALLEL_BAND == current ? w.stack : w.outgoing;
+            bool inRun = false;
+
+            for (size_t i = rowStart; i <= rowStart + (right - left) + 2; ++i) {
+              const std::uint8_t bits = load(i, scanEdge);
+
+              if (bits & SKIP) {
+                inRun = false;
+                continue;
+              } else if (bits & tile::ADJACENT) {
+                inRun = false;
+              } else if (!inRun) {
+                inRun = true;
+                if (claim(i, scanEdge)) {
+                  seeds.push_back(i);
+                  appendRun(w.runs, scanRow, left - 1 - rowBase + (i - rowStart), 1);
+                  ++w.revealed;
+                }
+                continue;
+              } else {
+                continue;
+              }
+
+              if (claim(i, scanEdge)) {
+                appendRun(w.runs, scanRow, left - 1 - rowBase + (i - rowStart), 1);
+                ++w.revealed;
+              }
+            }
+          }
+        };
+
+        const auto work = [&](unsigned int self) {
+          worker& w = workers[self];
+          std::unique_lock<std::mutex> guard(lock);
+
+          while (true) {
+            ++waiting;
+            while (ready.empty() && active != 0) {
+              wake.wait(guard);
+            }
+            --waiting;
+            if (ready.empty()) {
+              return;
+            }
+
+            const size_t current = ready.back();
+            ready.pop_back();
+            band& b = bands[current];
+            b.queued = false;
+            b.busy = true;
+            ++active;
+
+            // Fill the band until no more seeds arrive for it, passing on seeds for other bands early if any thread
+            // is waiting for work
+            while (!b.inbox.empty()) {
+              w.stack.swap(b.inbox);
+              guard.unlock();
+
+              while (!w.stack.empty()) {
+                const size_t start = w.stack.back();
+                w.stack.pop_back();
+                fill(w, current, start);
+
+                if (!w.outgoing.empty() && waiting.load(std::memory_order_relaxed) != 0) {
+                  std::lock_guard<std::mutex> flush(lock);
+                  deliver(w.outgoing);
+                }
+              }
+
+              guard.lock();
+              deliver(w.outgoing);
+            }
+
+            b.busy = false;
+            if (--active == 0) {
+              wake.notify_all();
+            }
+          }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < threadCount; ++t) {
+          threads.emplace_back(work, t);
+        }
+        work(0);
+        for (std::thread& thread : threads) {
+          thread.join();
+        }
+
+        workers[0].runs.swap(this->changes.changed);
+        size_t revealed = 0;
+        for (const worker& w : workers) {
+          if (&w != &workers[0]) {
+            this->changes.changed.insert(this->changes.changed.end(), w.runs.begin(), w.runs.end());
+          }
+          revealed += w.revealed;
+        }
+
+        return revealed;
+      }
+
+      unsigned short int adjacentFlagCount(size_t index) const {
+        unsigned short int count = 0;
+
+        for (std::ptrdiff_t offset : this->offsets()) {
+          count += this->grid[index + offset].isFlagged();
+        }
+
+        return count;
+      }
+
+    private:
+      random_engine rng;
+      std::conditional_t<FIXED, fixed_tile_buffer<(W + 2) * (H + 2)>, tile_buffer> grid;
+      // Only used when the size is not fixed
+      size_t gridWidth = 0, gridHeight = 0, gridStride = 0;
+      std::array<std::ptrdiff_t, 8> neighbourOffsets;
+      // Reused between flood fills so that revealing does not allocate
+      std::vector<size_t> fillStack;
+
+      change_set changes;
+      bool batching = false;
+
+      bool keepHistory = false, redoing = false;
+      std::vector<history_entry> history;
+      std::string historyLog;
+      // Actions in effect; the rest of the history has been undone and can be redone
+      size_t historyDepth = 0;
+      // Set up by startHistory() for recordHistory()
+      history_entry pendingEntry;
+      size_t historyRun = 0, historyRunLength = 0;
+      std::vector<std::pair<unsigned long int, unsigned long int>> historyMoves;
+
+      unsigned long int mineTotal = 0;
+      bool firstReveal = true;
+      bool safeOpening = false;
+
+      // Counters kept up to date by every action, so the game state can be read in constant time
+      size_t revealedSafe = 0, flaggedTiles = 0;
+      bool mineRevealed = false;
+
+    public:
+      inline size_t width() const {
+        if constexpr (FIXED) {
+          return W;
+        } else {
+          return this->gridWidth;
+        }
+      }
+
+      inline size_t height() const {
+        if constexpr (FIXED) {
+          return H;
+        } else {
+          return this->gridHeight;
+        }
+      }
+
+      grid_view getGrid() const {
+        return grid_view(this->grid.data(), this->width(), this->height(), this->stride());
+      }
+
+      size_t mineCount() const {
+        return this->mineTotal;
+      }
+
+      size_t flagCount() const {
+        return this->flaggedTiles;
+      }
+
+      // Number of tiles without a mine that have been revealed
+      size_t revealedCount() const {
+        return this->revealedSafe;
+      }
+
+      status state() const {
+        if (this->mineRevealed) {
+          return status::LOST;
+        }
+
+        if (this->revealedSafe == this->width() * this->height() - this->mineCount()) {
+          return status::WON;
+        }
+
+        return status::PLAYING;
+      }
+
+      bool isAllExceptMinesRevealed() const {
+        return this->state() == status::WON;
+      }
+
+      bool isMineRevealed() const {
+        return this->mineRevealed;
+      }
+  };
+
+  using game = basic_game<>;
+
+  template<unsigned int W, unsigned int H>
+  using fixed_game = basic_game<W, H>;
+
+  // The classic difficulties
+  using beginner_game = fixed_game<9, 9>;
+  using intermediate_game = fixed_game<16, 16>;
+  using expert_game = fixed_game<30, 16>;
 };
 
 #endif
@@ -0,0 +1,119 @@
+#ifndef MINESWEEPER_NOGUESS
+#define MINESWEEPER_NOGUESS
+
+#include "mines.hpp"
+#include "random.hpp"
+#include "solver.hpp"
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace minesweeper {
+  // Reveal a tile, and if it is the first reveal deal a board that the solver can clear from there without guessing.
+  // Candidate boards are numbered and dealt from streams split from the game's generator, then played out on every
+  // core. The lowest numbered board that can be cleared wins, so a seeded game deals the same board on every run, and
+  // workers stop once nothing below the best so far is left to try.
+  // If none is found within maxAttempts the board is dealt at random as usual.
+  // Boards dealt this way always have a safe opening, since a lone number can rarely be solved from. Flags placed
+  // before the first reveal are kept, and a flagged tile is left alone as reveal() would.
+  static inline const game::change_set& revealWithoutGuessing(game& g, size_t row, size_t col, size_t maxAttempts = 1000) {
+    if (!g.isFirstReveal()) {
+      return g.reveal(row, col);
+    }
+    // Checked here, since the workers could not pass the error on
+    if (row >= g.height() || col >= g.width()) {
+      throw std::out_of_range("Tile position is outside of the game board.");
+    }
+    if (g.getGrid()(row, col).isFlagged()) {
+      return g.reveal(row, col);
+    }
+
+    const unsigned int width = g.width(), height = g.height();
+    const unsigned long int mineCount = g.mineCount();
+    const random_engine streams = g.generator().split(g.generator()());
+
+    // Every candidate gets the player's flags before its reveal, so the reveal stops at them as it would have here
+    std::vector<unsigned long int> flags;
+    const auto grid = g.getGrid();
+    for (size_t r = 0; r < height; ++r) {
+      for (size_t c = 0; c < width; ++c) {
+        if (grid(r, c).isFlagged()) {
+          flags.push_back(r * width + c);
+        }
+      }
+    }
+
+    std::atomic<size_t> nextAttempt = 0, best = SIZE_MAX;
+    std::optional<game> winner;
+    std::mutex winnerMutex;
+
+    const auto work = [&]() {
+      game candidate(width, height, mineCount, 0);
+      candidate.setSafeOpening(true);
+
+      for (size_t attempt = nextAttempt++; attempt < maxAttempts && attempt < best; attempt = nextAttempt++) {
+        candidate.generator() = streams.split(attempt);
+        candidate.initialise(width, height, mineCount);
+        for (unsigned long int position : flags) {
+          candidate.flag(position);
+        }
+        candidate.reveal(row, col);
+
+        // Play a copy out by deduction alone, giving up as soon as a lower numbered board succeeds. The player's
+        // flags are guesses, so the copy takes them off and works out those tiles like any other.
+        game trial = candidate;
+        for (unsigned long int position : flags) {
+          trial.flag(position);
+        }
+        solver s(trial);
+        for (const auto* deduced = &s.solve(); !deduced->empty() && attempt < best; deduced = &s.solve()) {
+          trial.beginBatch();
+          for (unsigned long int position : deduced->mines) {
+            trial.flag(position);
+          }
+          for (unsigned long int position : deduced->safe) {
+            trial.reveal(position);
+          }
+          s.update(trial.commit());
+        }
+
+        if (trial.state() == game::status::WON) {
+          std::lock_guard lock(winnerMutex);
+          if (attempt < best) {
+            winner = std::move(candidate);
+            best = attempt;
+          }
+          return;
+        }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < std::thread::hardware_concurrency(); ++t) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+
+    if (!winner) {
+      return g.reveal(row, col);
+    }
+
+    // Keep the player's settings, but take the winning board as it stands after its first reveal. It has the same
+    // flags, so its changes are what the player sees change. Its history starts from there, since nothing before it
+    // happened on this board.
+    const bool safeOpening = g.hasSafeOpening(), undoHistory = g.hasUndoHistory();
+    g = std::move(*winner);
+    g.setSafeOpening(safeOpening);
+    g.setUndoHistory(undoHistory);
+    return g.lastChanges();
+  }
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
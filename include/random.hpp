@@ -0,0 +1,100 @@
+#ifndef MINESWEEPER_RANDOM
+#define MINESWEEPER_RANDOM
+
+#include <cstdint>
+
+namespace minesweeper {
+  // A counter-based generator in the style of SplitMix64: the nth number of a stream is a strong mix of the stream's
+  // key and n. It holds only two words, can jump anywhere in its stream at once, and derives independent streams for
+  // boards, threads or chunks without any shared state. Unlike the standard engines and distributions, it gives the
+  // same numbers with every standard library.
+  class random_engine {
+    public:
+      using result_type = std::uint64_t;
+
+      random_engine() : random_engine(0) {}
+
+      explicit random_engine(std::uint64_t value) {
+        this->seed(value);
+      }
+
+      // Start a new stream, which is the same for the same seed every time
+      void seed(std::uint64_t value) {
+        this->key = mix(value);
+        this->counter = 0;
+      }
+
+      static constexpr result_type min() {
+        return 0;
+      }
+
+      static constexpr result_type max() {
+        return UINT64_MAX;
+      }
+
+      result_type operator()() {
+        return this->at(this->counter++);
+      }
+
+      // The number at any place in the stream, without moving along it
+      result_type at(std::uint64_t index) const {
+        return mix(this->key + index * GAMMA);
+      }
+
+      void discard(std::uint64_t count) {
+        this->counter += count;
+      }
+
+      // An independent stream, numbered so that the same one can be derived again anywhere
+      random_engine split(std::uint64_t stream) const {
+        random_engine r;
+        r.key = mix(this->key ^ mix(stream + GAMMA));
+        return r;
+      }
+
+      // A uniform number below bound, which must not be zero. Multiplying rather than dividing keeps this fast, and
+      // the few products that would be biased are drawn again.
+      std::uint64_t below(std::uint64_t bound) {
+        unsigned __int128 product = (unsigned __int128)(*this)() * bound;
+        if ((std::uint64_t)product < bound) {
+          const std::uint64_t threshold = -bound % bound;
+          while ((std::uint64_t)product < threshold) {
+            product = (unsigned __int128)(*this)() * bound;
+          }
+        }
+        return product >> 64;
+      }
+
+      // The whole state, so a generator can be saved and picked up again where it left off
+      std::uint64_t getKey() const {
+        return this->key;
+      }
+
+      std::uint64_t getCounter() const {
+        return this->counter;
+      }
+
+      void restore(std::uint64_t savedKey, std::uint64_t savedCounter) {
+        this->key = savedKey;
+        this->counter = savedCounter;
+      }
+
+      bool operator==(const random_engine&) const = default;
+
+      // A bijective mix with good avalanche, the finaliser of SplitMix64
+      static constexpr std::uint64_t mix(std::uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+      }
+
+    private:
+      // The golden ratio as a 64 bit fraction, which spreads consecutive counters over the whole word
+      static constexpr std::uint64_t GAMMA = 0x9e3779b97f4a7c15;
+
+      std::uint64_t key = 0, counter = 0;
+  };
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
@@ -0,0 +1,355 @@
+#ifndef MINESWEEPER_REPLAY
+#define MINESWEEPER_REPLAY
+
+#include "mines.hpp"
+#include "noguess.hpp"
+#include "varint.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace minesweeper {
+  // A compact log of the actions taken in a game. Together with the seed and size the board was dealt from, it plays
+  // the game back exactly. Each action is stored as a varint of the milliseconds since the one before, shifted left to
+  // make room for its kind, then a zigzag varint of how far it moved from the position before, so most actions take
+  // two or three bytes however large the board is.
+  //
+  // Only actions made through the replay are recorded, and the board must not be changed in any other way while
+  // recording, or the playback will drift from the game.
+  class replay {
+    public:
+      enum struct kind : std::uint8_t {
+        REVEAL = 0,
+        FLAG = 1,
+        // A reveal of an already revealed tile, which opens its neighbours
+        CHORD = 2,
+        // A reveal through revealWithoutGuessing(), which deals the same board for the same seed
+        NO_GUESS = 3,
+        // Taking back the latest action, or making the latest one taken back again, through the game's history
+        UNDO = 4,
+        REDO = 5
+      };
+
+      struct action {
+        kind type;
+        unsigned long int position;
+        // Milliseconds since the recording started
+        std::uint64_t time;
+      };
+
+      // Start recording a game dealt from seed; call deal() to set the board up
+      replay(std::uint64_t seed, unsigned int width, unsigned int height, unsigned long int mineCount, bool safeOpening = false)
+        : boardSeed(seed), boardWidth(width), boardHeight(height), mines(mineCount), safe(safeOpening) {
+        if (width == 0 || height == 0) {
+          throw std::invalid_argument("Invalid width or height of game board.");
+        }
+        if (mineCount > (size_t)width * height) {
+          throw std::out_of_range("Requested mine count exceeds size of board.");
+        }
+      }
+
+      // Deal the board the recording starts from, which is the same every time. A recording that undoes actions
+      // turns on the game's history so that it can play them back.
+      void deal(game& g) const {
+        g.seed(this->boardSeed);
+        g.setSafeOpening(this->safe);
+        if (this->usesUndo) {
+          g.setUndoHistory(true);
+        }
+        g.initialise(this->boardWidth, this->boardHeight, this->mines);
+      }
+
+      // Reveal (or chord) a tile and record it
+      const game::change_set& reveal(game& g, unsigned long int position) {
+        const auto [row, col] = intToCoords(g.width(), position);
+        const kind type = row < g.height() && g.getGrid()(row, col).isRevealed() ? kind::CHORD : kind::REVEAL;
+        const game::change_set& changes = g.reveal(position);
+        this->record(type, position);
+        return changes;
+      }
+
+      // Chord a tile and record it, returning how many tiles were opened
+      size_t chord(game& g, unsigned long int position) {
+        const size_t opened = g.chord(position);
+        this->record(kind::CHORD, position);
+        return opened;
+      }
+
+      // Only the first reveal deals a new board, so the rest are recorded as plain reveals
+      const game::change_set& revealWithoutGuessing(game& g, unsigned long int position) {
+        if (!g.isFirstReveal()) {
+          return this->reveal(g, position);
+        }
+
+        const auto [row, col] = intToCoords(g.width(), position);
+        const game::change_set& changes = minesweeper::revealWithoutGuessing(g, row, col);
+        this->record(kind::NO_GUESS, position);
+        return changes;
+      }
+
+      const game::change_set& flag(game& g, unsigned long int position) {
+        const game::change_set& changes = g.flag(position);
+        this->record(kind::FLAG, position);
+        return changes;
+      }
+
+      // Undo the latest action and record it. The game must keep its history from the start of the recording.
+      const game::change_set& undo(game& g) {
+        const game::change_set& changes = g.undo();
+        this->usesUndo = true;
+        this->record(kind::UNDO, this->lastPosition);
+        return changes;
+      }
+
+      const game::change_set& redo(game& g) {
+        const game::change_set& changes = g.redo();
+        this->usesUndo = true;
+        this->record(kind::REDO, this->lastPosition);
+        return changes;
+      }
+
+      const game::change_set& reveal(game& g, unsigned int row, unsigned int col) {
+        return this->reveal(g, coordsToInt(g.width(), {row, col}));
+      }
+
+      const game::change_set& revealWithoutGuessing(game& g, unsigned int row, unsigned int col) {
+        return this->revealWithoutGuessing(g, coordsToInt(g.width(), {row, col}));
+      }
+
+      size_t chord(game& g, unsigned int row, unsigned int col) {
+        return this->chord(g, coordsToInt(g.width(), {row, col}));
+      }
+
+      const game::change_set& flag(game& g, unsigned int row, unsigned int col) {
+        return this->flag(g, coordsToInt(g.width(), {row, col}));
+      }
+
+      std::uint64_t seed() const {
+        return this->boardSeed;
+      }
+
+      unsigned int width() const {
+        return this->boardWidth;
+      }
+
+      unsigned int height() const {
+        return this->boardHeight;
+      }
+
+      unsigned long int mineCount() const {
+        return this->mines;
+      }
+
+      bool hasSafeOpening() const {
+        return this->safe;
+      }
+
+      // Number of actions recorded
+      size_t size() const {
+        return this->count;
+      }
+
+      // The whole recording as bytes: a magic string and version, the board, the number of actions, then the actions
+      std::string encode() const {
+        std::string out(MAGIC);
+        putVarint(out, VERSION);
+        putVarint(out, this->boardSeed);
+        putVarint(out, this->boardWidth);
+        putVarint(out, this->boardHeight);
+        putVarint(out, this->mines);
+        putVarint(out, this->safe);
+        putVarint(out, this->count);
+        return out + this->actions;
+      }
+
+      // Read a recording made by encode(), or by the version before, which had no room for undoing actions. Recording
+      // may carry on from where it left off.
+      static replay decode(std::string_view in) {
+        if (!in.starts_with(MAGIC)) {
+          throw std::runtime_error("Not a replay.");
+        }
+
+        size_t offset = MAGIC.size();
+        const std::uint64_t version = getVarint(in, offset);
+        if (version != VERSION && version != 2) {
+          throw std::runtime_error("Unsupported replay version.");
+        }
+
+        const std::uint64_t seed = getVarint(in, offset);
+        const std::uint64_t width = getVarint(in, offset);
+        const std::uint64_t height = getVarint(in, offset);
+        const std::uint64_t mineCount = getVarint(in, offset);
+        const std::uint64_t safeOpening = getVarint(in, offset);
+        const std::uint64_t count = getVarint(in, offset);
+        if (width > UINT32_MAX || height > UINT32_MAX || safeOpening > 1) {
+          throw std::runtime_error("Replay is damaged.");
+        }
+
+        replay r(seed, width, height, mineCount, safeOpening);
+        r.count = count;
+
+        // Walk the actions once, both to check them and to find where recording left off. Older recordings are
+        // written out again with the wider kinds as they go.
+        const std::string_view actions = in.substr(offset);
+        size_t actionOffset = 0;
+        unsigned long int oldPosition = 0;
+        std::uint64_t oldTime = 0;
+        for (size_t i = 0; i < count; ++i) {
+          if (version == VERSION) {
+            const kind type = readAction(actions, actionOffset, r.lastPosition, r.lastTime).type;
+            r.usesUndo |= type == kind::UNDO || type == kind::REDO;
+          } else {
+            putAction(r.actions, readAction(actions, actionOffset, oldPosition, oldTime, 2), r.lastPosition, r.lastTime);
+          }
+        }
+        if (actionOffset != actions.size()) {
+          throw std::runtime_error("Replay is damaged.");
+        }
+        if (version == VERSION) {
+          r.actions = actions;
+        }
+
+        r.start = std::chrono::steady_clock::now() - std::chrono::milliseconds(r.lastTime);
+        return r;
+      }
+
+      void save(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        const std::string data = this->encode();
+        if (!file.write(data.data(), data.size())) {
+          throw std::runtime_error("Could not write replay file.");
+        }
+      }
+
+      static replay load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+          throw std::runtime_error("Could not open replay file.");
+        }
+        return decode(std::string(std::istreambuf_iterator<char>(file), {}));
+      }
+
+      // Steps through the actions of a recording, which must outlive it
+      class player {
+        public:
+          explicit player(const replay& r) : recording(r) {}
+
+          // Whether every action has been played
+          bool done() const {
+            return this->played == this->recording.count;
+          }
+
+          // Number of actions played so far
+          size_t position() const {
+            return this->played;
+          }
+
+          // Move past the next action without playing it
+          action next() {
+            if (this->done()) {
+              throw std::out_of_range("No actions left to play.");
+            }
+
+            ++this->played;
+            return readAction(this->recording.actions, this->offset, this->lastPosition, this->lastTime);
+          }
+
+          // Play the next action on a board dealt by the recording, returning the changes it made
+          const game::change_set& step(game& g) {
+            const action a = this->next();
+            switch (a.type) {
+              case kind::FLAG:
+                return g.flag(a.position);
+              case kind::CHORD:
+                g.chord(a.position);
+                return g.lastChanges();
+              case kind::NO_GUESS: {
+                const auto [row, col] = intToCoords(g.width(), a.position);
+                return minesweeper::revealWithoutGuessing(g, row, col);
+              }
+              case kind::UNDO:
+                return g.undo();
+              case kind::REDO:
+                return g.redo();
+              default:
+                return g.reveal(a.position);
+            }
+          }
+
+          // Play every remaining action, as fast as the engine allows
+          void fastForward(game& g) {
+            while (!this->done()) {
+              this->step(g);
+            }
+          }
+
+        private:
+          const replay& recording;
+          size_t offset = 0, played = 0;
+          unsigned long int lastPosition = 0;
+          std::uint64_t lastTime = 0;
+      };
+
+    private:
+      static constexpr std::string_view MAGIC = "MINESREC";
+      static constexpr std::uint64_t VERSION = 3;
+      // Low bits of each action's first varint that hold its kind
+      static constexpr unsigned int KIND_BITS = 3;
+
+      // Decode the action at offset, which follows one at lastPosition and lastTime, and move all three past it
+      static action readAction(std::string_view in, size_t& offset, unsigned long int& lastPosition, std::uint64_t& lastTime,
+          unsigned int kindBits = KIND_BITS) {
+        const std::uint64_t head = getVarint(in, offset);
+        const std::uint64_t step = getVarint(in, offset);
+
+        const std::uint64_t type = head & ((1 << kindBits) - 1);
+        if (type > (std::uint64_t)kind::REDO) {
+          throw std::runtime_error("Replay is damaged.");
+        }
+
+        lastPosition += unzigzag(step);
+        lastTime += head >> kindBits;
+        return action{(kind)type, lastPosition, lastTime};
+      }
+
+      // Encode an action that follows one at lastPosition and lastTime, and move both on to it
+      static void putAction(std::string& out, const action& a, unsigned long int& lastPosition, std::uint64_t& lastTime) {
+        putVarint(out, (a.time - lastTime) << KIND_BITS | (std::uint64_t)a.type);
+        putVarint(out, zigzag((std::int64_t)(a.position - lastPosition)));
+
+        lastPosition = a.position;
+        lastTime = a.time;
+      }
+
+      void record(kind type, unsigned long int position) {
+        const std::uint64_t time = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - this->start).count();
+
+        // The clock never runs backwards, but a decoded recording may have started later than its last action
+        putAction(this->actions, action{type, position, std::max(time, this->lastTime)}, this->lastPosition, this->lastTime);
+        ++this->count;
+      }
+
+    private:
+      std::uint64_t boardSeed;
+      unsigned int boardWidth, boardHeight;
+      unsigned long int mines;
+      bool safe;
+
+      std::string actions;
+      size_t count = 0;
+      unsigned long int lastPosition = 0;
+      std::uint64_t lastTime = 0;
+      // Whether any action recorded so far undoes or redoes another
+      bool usesUndo = false;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  };
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
@@ -0,0 +1,233 @@
+#ifndef MINESWEEPER_SIMULATOR
+#define MINESWEEPER_SIMULATOR
+
+#include "mines.hpp"
+#include "random.hpp"
+#include "solver.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace minesweeper {
+  // Totals over a batch of simulated games
+  struct simulation_result {
+    size_t games = 0, won = 0, lost = 0;
+    // Safe tiles revealed over every game, a measure of how far the strategy gets when it does not win
+    size_t revealed = 0;
+
+    double winRate() const {
+      return this->games == 0 ? 0 : (double)this->won / this->games;
+    }
+
+    simulation_result& operator+=(const simulation_result& other) {
+      this->games += other.games;
+      this->won += other.won;
+      this->lost += other.lost;
+      this->revealed += other.revealed;
+      return *this;
+    }
+  };
+
+  // Plays by deduction, revealing a random hidden tile whenever it is stuck
+  template<typename Game = game>
+  class solver_strategy {
+    public:
+      void operator()(Game& g, random_engine& rng) {
+        // Each thread has its own copy of the strategy and its own game, so the solver is only built once
+        if (!this->s || this->boundTo != &g) {
+          this->s.emplace(g);
+          this->boundTo = &g;
+        } else {
+          this->s->reset();
+        }
+
+        const auto grid = g.getGrid();
+        this->s->update(g.reveal(g.height() / 2, g.width() / 2));
+        while (g.state() == game::status::PLAYING) {
+          const auto& deduced = this->s->solve();
+
+          if (deduced.empty()) {
+            this->hidden.clear();
+            for (size_t row = 0; row < g.height(); ++row) {
+              for (size_t col = 0; col < g.width(); ++col) {
+                if (!grid(row, col).isRevealed() && !grid(row, col).isFlagged()) {
+                  this->hidden.push_back(row * g.width() + col);
+                }
+              }
+            }
+
+            this->s->update(g.reveal(this->hidden[rng.below(this->hidden.size())]));
+            continue;
+          }
+
+          g.beginBatch();
+          for (unsigned long int position : deduced.mines) {
+            g.flag(position);
+          }
+          for (unsigned long int position : deduced.safe) {
+            g.reveal(position);
+          }
+          this->s->update(g.commit());
+        }
+      }
+
+    private:
+      std::optional<basic_solver<Game>> s;
+      const Game* boundTo = nullptr;
+      std::vector<unsigned long int> hidden;
+  };
+
+  // Play many games of one size with a strategy, called as strategy(Game&, random_engine&) on a freshly dealt board.
+  // Game may be a fixed_game of the same size, which plays the same games faster. Every thread works on its own copy
+  // of the strategy and its own game, taking games in batches and stealing half of another thread's remaining games
+  // when it runs out. Each game is dealt from its own stream split from the seed, so the results do not depend on how
+  // the games were spread over the threads. An exception thrown while playing, such as by the strategy, stops the run
+  // and is thrown again on the calling thread.
+  template<typename Game = game, typename Strategy>
+  simulation_result simulate(unsigned int width, unsigned int height, unsigned long int mineCount, size_t games,
+      const Strategy& strategy, std::uint64_t seed = std::chrono::high_resolution_clock::now().time_since_epoch().count(),
+      unsigned int threadCount = std::thread::hardware_concurrency()) {
+    // Games taken from a thread's own range at a time
+    constexpr std::uint64_t BATCH = 32;
+    // Ranges are packed into one word, so very large runs are played in rounds
+    constexpr std::uint64_t ROUND = 0xffffffff;
+
+    const random_engine streams(seed);
+
+    // Check the size here, where an invalid one can be thrown to the caller rather than ending the program
+    {
+      const Game check(width, height, mineCount);
+    }
+
+    // Kept on separate cache lines, so threads never write to the same one
+    struct alignas(64) worker {
+      // The games still to be played, as first << 32 | end
+      std::atomic<std::uint64_t> range = 0;
+      simulation_result result;
+      std::exception_ptr error;
+    };
+
+    threadCount = std::max(threadCount, 1u);
+    std::vector<worker> workers(threadCount);
+    std::atomic<bool> failed = false;
+
+    const auto pack = [](std::uint64_t first, std::uint64_t end) {
+      return first << 32 | end;
+    };
+
+    // Take up to count games from the front of a range, or when stealing, the back half of it
+    const auto take = [&](worker& from, bool steal, std::uint64_t& first, std::uint64_t& end) {
+      std::uint64_t range = from.range.load();
+      while (true) {
+        const std::uint64_t rangeFirst = range >> 32, rangeEnd = range & 0xffffffff;
+        if (rangeFirst >= rangeEnd) {
+          return false;
+        }
+
+        if (steal) {
+          first = rangeFirst + (rangeEnd - rangeFirst) / 2;
+          end = rangeEnd;
+          if (from.range.compare_exchange_weak(range, pack(rangeFirst, first))) {
+            return true;
+          }
+        } else {
+          first = rangeFirst;
+          end = std::min(rangeFirst + BATCH, rangeEnd);
+          if (from.range.compare_exchange_weak(range, pack(end, rangeEnd))) {
+            return true;
+          }
+        }
+      }
+    };
+
+    for (size_t offset = 0; offset < games; offset += ROUND) {
+      const std::uint64_t roundGames = std::min<std::uint64_t>(games - offset, ROUND);
+      for (unsigned int t = 0; t < threadCount; ++t) {
+        workers[t].range = pack(roundGames * t / threadCount, roundGames * (t + 1) / threadCount);
+      }
+
+      const auto work = [&](unsigned int self) {
+        Game g(width, height, mineCount);
+        Strategy play = strategy;
+        random_engine rng;
+        simulation_result result;
+
+        // Stop taking games once another thread has failed
+        while (!failed) {
+          std::uint64_t first, end;
+
+          if (!take(workers[self], false, first, end)) {
+            // Out of games, so steal from the others, starting with the next thread along
+            bool stolen = false;
+            for (unsigned int t = 1; t < threadCount && !stolen; ++t) {
+              stolen = take(workers[(self + t) % threadCount], true, first, end);
+            }
+            if (!stolen) {
+              break;
+            }
+
+            // Play the first batch now and leave the rest where others may steal it in turn
+            workers[self].range = pack(std::min(first + BATCH, end), end);
+            end = std::min(first + BATCH, end);
+          }
+
+          for (std::uint64_t i = first; i < end; ++i) {
+            // One stream deals the board and another makes the strategy's choices
+            const random_engine gameStream = streams.split(offset + i);
+            g.generator() = gameStream.split(0);
+            g.initialise(width, height, mineCount);
+            rng = gameStream.split(1);
+
+            play(g, rng);
+
+            ++result.games;
+            result.won += g.state() == game::status::WON;
+            result.lost += g.state() == game::status::LOST;
+            result.revealed += g.revealedCount();
+          }
+        }
+
+        workers[self].result += result;
+      };
+
+      // Keep what a thread throws for the caller, and have the others stop
+      const auto guarded = [&](unsigned int self) {
+        try {
+          work(self);
+        } catch (...) {
+          workers[self].error = std::current_exception();
+          failed = true;
+        }
+      };
+
+      std::vector<std::thread> threads;
+      for (unsigned int t = 1; t < threadCount; ++t) {
+        threads.emplace_back(guarded, t);
+      }
+      guarded(0);
+      for (std::thread& thread : threads) {
+        thread.join();
+      }
+
+      for (const worker& w : workers) {
+        if (w.error) {
+          std::rethrow_exception(w.error);
+        }
+      }
+    }
+
+    simulation_result total;
+    for (const worker& w : workers) {
+      total += w.result;
+    }
+    return total;
+  }
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
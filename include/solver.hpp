@@ -0,0 +1,680 @@
+#ifndef MINESWEEPER_SOLVER
+#define MINESWEEPER_SOLVER
+
+#include "mines.hpp"
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace minesweeper {
+  // Deduces tiles that are certainly safe or certainly mines from what the player can see: the revealed numbers and
+  // the flags, which are trusted to be correct. The frontier is kept up to date from each action's change_set, so
+  // only the constraints around the changed tiles are looked at again. Works with a game of any size.
+  template<typename Game = game>
+  class basic_solver {
+    public:
+      // Tiles deduced by solve(), as positions accepted by game::reveal() and game::flag()
+      struct deductions {
+        std::vector<unsigned long int> safe, mines;
+
+        bool empty() const {
+          return this->safe.empty() && this->mines.empty();
+        }
+      };
+
+      explicit basic_solver(const Game& g) : g(g) {
+        this->reset();
+      }
+
+      // Rebuild from the whole board, needed whenever the game is initialised again
+      void reset() {
+        const auto grid = this->g.getGrid();
+        this->columns = grid.width();
+        this->rows = grid.height();
+        this->stride = this->columns + 2;
+        this->cells.assign(this->stride * (this->rows + 2), BORDER);
+        this->queue.clear();
+
+        for (size_t i = 0; i < game_types::NEIGHBOURS.size(); ++i) {
+          const auto [rowOffset, colOffset] = game_types::NEIGHBOURS[i];
+          this->neighbourOffsets[i] = rowOffset * (std::ptrdiff_t)this->stride + colOffset;
+        }
+
+        // Copy the whole board first, so that each number is only queued once
+        for (size_t row = 0; row < this->rows; ++row) {
+          const auto tiles = grid.row(row);
+          for (size_t col = 0; col < this->columns; ++col) {
+            this->cells[this->index(row, col)] = visibleState(tiles[col]);
+          }
+        }
+        for (size_t i = 0; i < this->cells.size(); ++i) {
+          this->enqueue(i);
+        }
+      }
+
+      // Take in the tiles changed by an action, or a batch of actions
+      void update(const game::change_set& changes) {
+        for (const auto& run : changes.runs()) {
+          for (size_t col = run.col; col < run.col + run.length; ++col) {
+            // Deductions may have relied on a flag that has since been removed
+            if (!this->observe(run.row, col)) {
+              this->reset();
+              return;
+            }
+          }
+        }
+      }
+
+      // Apply single tile and pairwise deductions until nothing more can be found, returning the newly deduced tiles
+      const deductions& solve() {
+        this->found.safe.clear();
+        this->found.mines.clear();
+        this->propagate();
+
+        return this->found;
+      }
+
+      // The exact chance of each tile holding a mine, in row-major order, given every arrangement of the remaining
+      // mines that fits the visible board is equally likely. Revealed and deduced safe tiles are 0, flags and deduced
+      // mines are 1. Returns an empty vector if no arrangement fits, which can only happen with a misplaced flag.
+      //
+      // A component with too many arrangements to count in reasonable time has its tiles treated as if they were in
+      // the interior, so they get the same chance as the tiles away from the numbers, and isExact() turns false.
+      std::vector<double> probabilities() {
+        this->propagate();
+
+        std::vector<double> chances(this->columns * this->rows, 0);
+        long int minesLeft = this->g.mineCount();
+        size_t interior = 0;
+        for (size_t row = 0; row < this->rows; ++row) {
+          for (size_t col = 0; col < this->columns; ++col) {
+            const size_t i = this->index(row, col);
+
+            if (this->cells[i] & (FLAGGED | MINE)) {
+              chances[row * this->columns + col] = 1;
+              --minesLeft;
+            } else if (this->isUnknown(i)) {
+              ++interior;
+            }
+          }
+        }
+
+        std::vector<component> components = this->components();
+        for (const component& c : components) {
+          interior -= c.tiles.size();
+        }
+        if (minesLeft < 0) {
+          return {};
+        }
+
+        // Count the arrangements of each component, biggest first so that no thread is left with a long tail
+        std::sort(components.begin(), components.end(), [](const component& a, const component& b) {
+          return a.tiles.size() > b.tiles.size();
+        });
+
+        std::atomic<size_t> next = 0;
+        const auto work = [&] {
+          for (size_t k; (k = next++) < components.size();) {
+            components[k].count(minesLeft);
+          }
+        };
+
+        const size_t threadCount = std::min<size_t>(std::thread::hardware_concurrency(), components.size());
+        if (threadCount > 1 && components.front().tiles.size() >= PARALLEL_THRESHOLD) {
+          std::vector<std::thread> threads;
+          for (size_t t = 1; t < threadCount; ++t) {
+            threads.emplace_back(work);
+          }
+          work();
+          for (std::thread& thread : threads) {
+            thread.join();
+          }
+        } else {
+          work();
+        }
+
+        this->exact = true;
+        std::erase_if(components, [this, &interior](const component& c) {
+          if (c.counted) {
+            return false;
+          }
+
+          interior += c.tiles.size();
+          this->exact = false;
+          return true;
+        });
+
+        if (!this->combine(components, minesLeft, interior, chances)) {
+          return {};
+        }
+
+        return chances;
+      }
+
+      // Whether every component was counted in full by the last call to probabilities()
+      bool isExact() const {
+        return this->exact;
+      }
+
+    private:
+      // Low nibble holds a revealed tile's number, as in game::tile
+      static constexpr std::uint16_t COUNT = 0x0f;
+      static constexpr std::uint16_t REVEALED = 0x10;
+      // Flagged tiles, and revealed mines
+      static constexpr std::uint16_t FLAGGED = 0x20;
+      static constexpr std::uint16_t BORDER = 0x80;
+      // Deduced by the solver
+      static constexpr std::uint16_t SAFE = 0x100;
+      static constexpr std::uint16_t MINE = 0x200;
+      // Waiting in the queue to be looked at again
+      static constexpr std::uint16_t QUEUED = 0x400;
+
+      // Components at least this big are counted on several threads
+      static constexpr size_t PARALLEL_THRESHOLD = 16;
+
+      // Work allowed for counting one component, in tiles tried, and the most tiles one may have before it is not
+      // counted at all. Either bounds the time and memory of a call to probabilities() on any board.
+      static constexpr long int COUNT_BUDGET = 1 << 22;
+      static constexpr size_t COUNT_LIMIT = 256;
+
+      // The hidden tiles around a revealed number which are not yet known, and how many mines remain among them
+      struct constraint {
+        std::array<size_t, 8> unknown;
+        unsigned int size = 0;
+        int mines = 0;
+      };
+
+      // Frontier tiles linked through the numbers they share, whose arrangements of mines can be counted on their own
+      struct component {
+        std::vector<size_t> tiles;
+        // The numbers touching each tile
+        std::vector<std::array<std::uint32_t, 8>> links;
+        std::vector<std::uint8_t> linkCount;
+        // For each number, the mines it still needs and the tiles around it still undecided
+        std::vector<int> needed, open;
+        std::vector<std::uint8_t> mined;
+
+        // Arrangements by number of mines, and for each tile the arrangements by number of mines that mine it
+        std::vector<double> weights, tileWeights;
+        // Whether the arrangements were all counted within the budget
+        bool counted = false;
+        long int budget = 0;
+
+        void count(long int minesLeft) {
+          const size_t size = this->tiles.size();
+          if (size > COUNT_LIMIT) {
+            return;
+          }
+
+          this->mined.assign(size, false);
+          this->weights.assign(size + 1, 0);
+          this->tileWeights.assign(size * (size + 1), 0);
+          this->budget = COUNT_BUDGET;
+          this->enumerate(0, 0, std::min<size_t>(minesLeft, size));
+
+          this->counted = this->budget >= 0;
+          if (!this->counted) {
+            return;
+          }
+
+          // Scale down so that large components cannot overflow when combined
+          const double largest = *std::max_element(this->weights.begin(), this->weights.end());
+          if (largest > 0) {
+            for (double& w : this->weights) {
+              w /= largest;
+            }
+            for (double& w : this->tileWeights) {
+              w /= largest;
+            }
+          }
+        }
+
+        // Try both states of each tile in turn, backing out as soon as any number cannot be satisfied
+        void enumerate(size_t tile, size_t mines, size_t limit) {
+          if (--this->budget < 0) {
+            return;
+          }
+
+          if (tile == this->tiles.size()) {
+            this->budget -= tile;
+            this->weights[mines] += 1;
+            for (size_t t = 0; t < this->tiles.size(); ++t) {
+              if (this->mined[t]) {
+                this->tileWeights[t * (this->tiles.size() + 1) + mines] += 1;
+              }
+            }
+            return;
+          }
+
+          for (bool mine : {false, true}) {
+            if (mine && mines == limit) {
+              break;
+            }
+
+            this->mined[tile] = mine;
+            if (this->place(tile, mine)) {
+              this->enumerate(tile + 1, mines + mine, limit);
+            }
+            this->unplace(tile, mine);
+          }
+          this->mined[tile] = false;
+        }
+
+        bool place(size_t tile, bool mine) {
+          bool fits = true;
+
+          for (std::uint8_t l = 0; l < this->linkCount[tile]; ++l) {
+            const std::uint32_t number = this->links[tile][l];
+            --this->open[number];
+            this->needed[number] -= mine;
+            fits &= this->needed[number] >= 0 && this->needed[number] <= this->open[number];
+          }
+
+          return fits;
+        }
+
+        void unplace(size_t tile, bool mine) {
+          for (std::uint8_t l = 0; l < this->linkCount[tile]; ++l) {
+            const std::uint32_t number = this->links[tile][l];
+            ++this->open[number];
+            this->needed[number] += mine;
+          }
+        }
+      };
+
+      // Split the unknown tiles next to numbers into independent components
+      std::vector<component> components() const {
+        constexpr std::uint32_t NONE = -1;
+
+        // Union-find over the frontier, joining the unknown tiles around each number
+        std::vector<size_t> parent(this->cells.size());
+        std::iota(parent.begin(), parent.end(), 0);
+        const auto find = [&](size_t i) {
+          while (parent[i] != i) {
+            i = parent[i] = parent[parent[i]];
+          }
+          return i;
+        };
+
+        for (size_t i = 0; i < this->cells.size(); ++i) {
+          if (this->isConstraint(i)) {
+            const constraint c = this->gather(i);
+            for (unsigned int u = 1; u < c.size; ++u) {
+              parent[find(c.unknown[u])] = find(c.unknown[0]);
+            }
+          }
+        }
+
+        // Number the components and their tiles in the order they are first reached
+        std::vector<component> components;
+        std::vector<std::uint32_t> componentOf(this->cells.size(), NONE), slot(this->cells.size(), NONE);
+        for (size_t i = 0; i < this->cells.size(); ++i) {
+          if (!this->isConstraint(i)) {
+            continue;
+          }
+
+          const constraint c = this->gather(i);
+          if (c.size == 0) {
+            continue;
+          }
+
+          const size_t root = find(c.unknown[0]);
+          if (componentOf[root] == NONE) {
+            componentOf[root] = components.size();
+            components.emplace_back();
+          }
+
+          component& k = components[componentOf[root]];
+          const std::uint32_t number = k.needed.size();
+          k.needed.push_back(c.mines);
+          k.open.push_back(c.size);
+
+          for (unsigned int u = 0; u < c.size; ++u) {
+            const size_t tile = c.unknown[u];
+            if (slot[tile] == NONE) {
+              slot[tile] = k.tiles.size();
+              k.tiles.push_back(tile);
+              k.links.emplace_back();
+              k.linkCount.push_back(0);
+            }
+
+            k.links[slot[tile]][k.linkCount[slot[tile]]++] = number;
+          }
+        }
+
+        return components;
+      }
+
+      // Weigh each component's arrangements by how many ways the other components and the interior tiles can hold
+      // the rest of the mines, then fill in the chance of every unknown tile
+      bool combine(const std::vector<component>& components, long int minesLeft, size_t interior, std::vector<double>& chances) const {
+        size_t frontierTiles = 0;
+        for (const component& c : components) {
+          frontierTiles += c.tiles.size();
+        }
+        const size_t most = std::min<size_t>(minesLeft, frontierTiles);
+
+        // Ways to place the rest of the mines in the interior, given how many the frontier holds, relative to the largest
+        std::vector<double> interiorWays(most + 1, 0);
+        {
+          std::vector<double> logWays(most + 1, -INFINITY);
+          double largest = -INFINITY;
+          for (size_t k = 0; k <= most; ++k) {
+            const long int rest = minesLeft - (long int)k;
+            if (rest <= (long int)interior) {
+              logWays[k] = std::lgamma(interior + 1.0) - std::lgamma(rest + 1.0) - std::lgamma(interior - rest + 1.0);
+              largest = std::max(largest, logWays[k]);
+            }
+          }
+          if (largest == -INFINITY) {
+            return false;
+          }
+          for (size_t k = 0; k <= most; ++k) {
+            interiorWays[k] = std::exp(logWays[k] - largest);
+          }
+        }
+
+        // Convolve the mine counts of the components before c with those of c
+        const auto extend = [most](const std::vector<double>& before, const component& c) {
+          std::vector<double> after(most + 1, 0);
+          for (size_t a = 0; a <= most; ++a) {
+            if (before[a] != 0) {
+              for (size_t k = 0; k < c.weights.size() && a + k <= most; ++k) {
+                after[a + k] += before[a] * c.weights[k];
+              }
+            }
+          }
+
+          const double largest = *std::max_element(after.begin(), after.end());
+          if (largest > 0) {
+            for (double& w : after) {
+              w /= largest;
+            }
+          }
+          return after;
+        };
+
+        // Keep every block'th prefix and recompute the ones in between, so memory grows with the square root of the
+        // number of components rather than linearly
+        const size_t count = components.size();
+        const size_t block = std::max<size_t>(1, std::sqrt(count));
+        std::vector<std::vector<double>> checkpoints;
+        std::vector<double> prefix(most + 1, 0);
+        prefix[0] = 1;
+        for (size_t c = 0; c < count; ++c) {
+          if (c % block == 0) {
+            checkpoints.push_back(prefix);
+          }
+          prefix = extend(prefix, components[c]);
+        }
+
+        // The interior shares whatever the frontier does not hold
+        double total = 0, interiorMines = 0;
+        for (size_t k = 0; k <= most; ++k) {
+          total += prefix[k] * interiorWays[k];
+          interiorMines += prefix[k] * interiorWays[k] * (minesLeft - (long int)k);
+        }
+        if (total <= 0) {
+          return false;
+        }
+
+        for (size_t i = 0; i < this->cells.size(); ++i) {
+          if (this->isUnknown(i)) {
+            chances[this->position(i)] = interior == 0 ? 0 : interiorMines / total / interior;
+          }
+        }
+
+        // Walk back through the components, carrying the weight of every mine count the later components and the
+        // interior can complete, then weigh each arrangement of c by the prefix before it and that suffix
+        std::vector<double> suffix = interiorWays;
+        for (size_t blockStart = (count == 0 ? 0 : (count - 1) / block * block); blockStart < count; blockStart -= block) {
+          std::vector<std::vector<double>> prefixes = {checkpoints[blockStart / block]};
+          const size_t blockEnd = std::min(blockStart + block, count);
+          for (size_t c = blockStart; c + 1 < blockEnd; ++c) {
+            prefixes.push_back(extend(prefixes.back(), components[c]));
+          }
+
+          for (size_t c = blockEnd; c-- > blockStart;) {
+            const component& k = components[c];
+            const std::vector<double>& before = prefixes[c - blockStart];
+
+            std::vector<double> ways(k.weights.size(), 0);
+            double componentTotal = 0;
+            for (size_t m = 0; m < k.weights.size(); ++m) {
+              for (size_t a = 0; a + m <= most; ++a) {
+                ways[m] += before[a] * suffix[a + m];
+              }
+              componentTotal += k.weights[m] * ways[m];
+            }
+            if (componentTotal <= 0) {
+              return false;
+            }
+
+            for (size_t t = 0; t < k.tiles.size(); ++t) {
+              double mined = 0;
+              for (size_t m = 0; m < k.weights.size(); ++m) {
+                mined += k.tileWeights[t * k.weights.size() + m] * ways[m];
+              }
+              chances[this->position(k.tiles[t])] = mined / componentTotal;
+            }
+
+            // Fold c into the suffix for the components before it
+            std::vector<double> folded(most + 1, 0);
+            for (size_t a = 0; a <= most; ++a) {
+              for (size_t m = 0; m < k.weights.size() && a + m <= most; ++m) {
+                folded[a] += k.weights[m] * suffix[a + m];
+              }
+            }
+            const double largest = *std::max_element(folded.begin(), folded.end());
+            if (largest > 0) {
+              for (double& w : folded) {
+                w /= largest;
+              }
+            }
+            suffix = std::move(folded);
+          }
+
+          if (blockStart == 0) {
+            break;
+          }
+        }
+
+        return true;
+      }
+
+      inline size_t index(size_t row, size_t col) const {
+        return (row + 1) * this->stride + col + 1;
+      }
+
+      unsigned long int position(size_t index) const {
+        return (index / this->stride - 1) * this->columns + index % this->stride - 1;
+      }
+
+      bool isConstraint(size_t index) const {
+        return (this->cells[index] & REVEALED) && (this->cells[index] & COUNT);
+      }
+
+      bool isUnknown(size_t index) const {
+        return !(this->cells[index] & (REVEALED | FLAGGED | BORDER | SAFE | MINE));
+      }
+
+      void propagate() {
+        while (!this->queue.empty()) {
+          const size_t i = this->queue.back();
+          this->queue.pop_back();
+          this->cells[i] &= ~QUEUED;
+
+          this->deduce(i);
+        }
+      }
+
+      void enqueue(size_t index) {
+        if (this->isConstraint(index) && !(this->cells[index] & QUEUED)) {
+          this->cells[index] |= QUEUED;
+          this->queue.push_back(index);
+        }
+      }
+
+      static std::uint16_t visibleState(const game::tile& t) {
+        if (t.isRevealed()) {
+          return t.isMine() ? FLAGGED : REVEALED | t.adjacentMineCount();
+        }
+
+        return t.isFlagged() ? FLAGGED : 0;
+      }
+
+      // Copy the visible state of a tile, queueing the numbers it affects.
+      // Returns false if a flag was removed.
+      bool observe(size_t row, size_t col) {
+        const size_t i = this->index(row, col);
+        const std::uint16_t visible = visibleState(this->g.getGrid()(row, col));
+
+        if ((this->cells[i] & FLAGGED) && !(visible & FLAGGED)) {
+          return false;
+        }
+
+        this->cells[i] = (this->cells[i] & ~(COUNT | REVEALED | FLAGGED)) | visible;
+        this->enqueue(i);
+        for (std::ptrdiff_t offset : this->neighbourOffsets) {
+          this->enqueue(i + offset);
+        }
+
+        return true;
+      }
+
+      constraint gather(size_t index) const {
+        constraint c;
+        c.mines = this->cells[index] & COUNT;
+
+        for (std::ptrdiff_t offset : this->neighbourOffsets) {
+          const size_t neighbour = index + offset;
+
+          if (this->cells[neighbour] & (FLAGGED | MINE)) {
+            --c.mines;
+          } else if (this->isUnknown(neighbour)) {
+            c.unknown[c.size++] = neighbour;
+          }
+        }
+
+        return c;
+      }
+
+      void mark(size_t index, std::uint16_t bit) {
+        if (!this->isUnknown(index)) {
+          return;
+        }
+
+        this->cells[index] |= bit;
+        (bit == SAFE ? this->found.safe : this->found.mines).push_back(this->position(index));
+
+        for (std::ptrdiff_t offset : this->neighbourOffsets) {
+          this->enqueue(index + offset);
+        }
+      }
+
+      void deduce(size_t index) {
+        const constraint c = this->gather(index);
+        if (c.size == 0) {
+          // No longer on the frontier
+          return;
+        }
+
+        // Single point: the remaining mines are either none or all of the unknown tiles
+        if (c.mines == 0 || c.mines == (int)c.size) {
+          for (unsigned int i = 0; i < c.size; ++i) {
+            this->mark(c.unknown[i], c.mines == 0 ? SAFE : MINE);
+          }
+          return;
+        }
+
+        // Pairwise, against every number close enough to share an unknown tile.
+        // Any deduction queues this tile again, so stop at the first one.
+        const size_t row = index / this->stride, col = index % this->stride;
+        for (int rowOffset = -2; rowOffset <= 2; ++rowOffset) {
+          for (int colOffset = -2; colOffset <= 2; ++colOffset) {
+            if ((rowOffset == 0 && colOffset == 0) ||
+                row + rowOffset < 1 || row + rowOffset > this->rows ||
+                col + colOffset < 1 || col + colOffset > this->columns) {
+              continue;
+            }
+
+            const size_t other = index + rowOffset * (std::ptrdiff_t)this->stride + colOffset;
+            if (!this->isConstraint(other)) {
+              continue;
+            }
+
+            const constraint d = this->gather(other);
+            if (this->compare(c, d)) {
+              return;
+            }
+          }
+        }
+      }
+
+      // If b needs as many more mines than a as it has tiles a does not cover, those tiles are all mines and a's
+      // mines all lie in the shared tiles, leaving the rest of a safe, and likewise the other way around.
+      // This covers both subsets and 1-2-1 patterns.
+      bool compare(const constraint& a, const constraint& b) {
+        std::array<size_t, 8> onlyA, onlyB;
+        unsigned int onlyASize = 0, onlyBSize = 0;
+
+        for (unsigned int i = 0; i < a.size; ++i) {
+          if (std::find(b.unknown.begin(), b.unknown.begin() + b.size, a.unknown[i]) == b.unknown.begin() + b.size) {
+            onlyA[onlyASize++] = a.unknown[i];
+          }
+        }
+        for (unsigned int i = 0; i < b.size; ++i) {
+          if (std::find(a.unknown.begin(), a.unknown.begin() + a.size, b.unknown[i]) == a.unknown.begin() + a.size) {
+            onlyB[onlyBSize++] = b.unknown[i];
+          }
+        }
+
+        // Nothing shared, or nothing left to deduce
+        if (onlyASize == a.size || onlyASize + onlyBSize == 0) {
+          return false;
+        }
+
+        std::uint16_t markA, markB;
+        if (b.mines - a.mines == (int)onlyBSize) {
+          markA = SAFE;
+          markB = MINE;
+        } else if (a.mines - b.mines == (int)onlyASize) {
+          markA = MINE;
+          markB = SAFE;
+        } else {
+          return false;
+        }
+
+        for (unsigned int i = 0; i < onlyASize; ++i) {
+          this->mark(onlyA[i], markA);
+        }
+        for (unsigned int i = 0; i < onlyBSize; ++i) {
+          this->mark(onlyB[i], markB);
+        }
+
+        return true;
+      }
+
+    private:
+      const Game& g;
+      size_t columns = 0, rows = 0, stride = 0;
+      std::array<std::ptrdiff_t, 8> neighbourOffsets;
+      // Visible state and deductions, padded by a border like the game's grid
+      std::vector<std::uint16_t> cells;
+      // Numbers whose surroundings changed since they were last looked at
+      std::vector<size_t> queue;
+      deductions found;
+      // Whether the last probabilities() counted every component in full
+      bool exact = true;
+  };
+
+  using solver = basic_solver<>;
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
@@ -0,0 +1,49 @@
+#ifndef MINESWEEPER_VARINT
+#define MINESWEEPER_VARINT
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace minesweeper {
+  // Seven bits per byte, lowest first, with the top bit set on every byte but the last. Used by both the undo history
+  // and recorded games, where most numbers are small.
+  static inline void putVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+      out += (char)((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+    out += (char)value;
+  }
+
+  // Read the varint at offset and move past it
+  static inline std::uint64_t getVarint(std::string_view in, size_t& offset) {
+    std::uint64_t value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+      if (offset >= in.size()) {
+        break;
+      }
+
+      const std::uint8_t byte = in[offset++];
+      value |= (std::uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+
+    throw std::runtime_error("Encoded data is damaged.");
+  }
+
+  // Signed steps folded onto 0, -1, 1, -2, 2..., so a short step either way makes a short varint
+  static inline std::uint64_t zigzag(std::int64_t value) {
+    return ((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63);
+  }
+
+  static inline std::int64_t unzigzag(std::uint64_t value) {
+    return (std::int64_t)(value >> 1) ^ -(std::int64_t)(value & 1);
+  }
+};
+
+#endif
+// vim: ts=2:sw=2:expandtab
@@ -0,0 +1,419 @@
+// Headless benchmarks for the game engine, printing one JSON object per line so runs can be compared between commits
+#include "../include/chunked.hpp"
+#include "../include/mines.hpp"
+#include "../include/noguess.hpp"
+#include "../include/replay.hpp"
+#include "../include/simulator.hpp"
+#include "../include/solver.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+// Count every allocation made through the global allocator
+static std::atomic<size_t> allocationCount = 0, allocatedBytes = 0;
+
+void* operator new(size_t size) {
+  ++allocationCount;
+  allocatedBytes += size;
+
+  if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+
+  throw std::bad_alloc();
+}
+
+// Kept out of line so the compiler does not mistake free() for a mismatched deallocation
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
+// Over-aligned types, such as the simulator's workers, are allocated through these instead
+void* operator new(size_t size, std::align_val_t alignment) {
+  ++allocationCount;
+  allocatedBytes += size;
+
+  // aligned_alloc() takes only whole multiples of the alignment
+  const size_t align = (size_t)alignment;
+  if (void* pointer = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) {
+    return pointer;
+  }
+
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+struct Options {
+  std::string filter;
+  double minTime = 0.2;
+  size_t maxTiles = 100'000'000;
+};
+
+struct Board {
+  unsigned int width, height;
+  double density;
+
+  unsigned long int mineCount() const {
+    return (unsigned long int)(this->density * this->width * this->height);
+  }
+
+  std::string name() const {
+    return std::to_string(this->width) + 'x' + std::to_string(this->height) + '/' + std::to_string((int)(this->density * 100 + 0.5)) + '%';
+  }
+};
+
+static long int peakResidentKilobytes() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Run setup (untimed) and operation (timed) until the minimum time has passed, then report the cost of one operation.
+// The operation returns how many operations it performed, so one call may cover several.
+static void run(const Options& options, const std::string& name, const Board& board,
+    const std::function<void()>& setup, const std::function<size_t()>& operation) {
+  if (name.find(options.filter) == std::string::npos || (size_t)board.width * board.height > options.maxTiles) {
+    return;
+  }
+
+  std::chrono::nanoseconds elapsed(0);
+  size_t operations = 0, allocations = 0, bytes = 0;
+  while (elapsed.count() < options.minTime * 1e9 || operations == 0) {
+    setup();
+
+    const size_t allocationsBefore = allocationCount, bytesBefore = allocatedBytes;
+    const auto start = std::chrono::steady_clock::now();
+    operations += operation();
+    elapsed += std::chrono::steady_clock::now() - start;
+    allocations += allocationCount - allocationsBefore;
+    bytes += allocatedBytes - bytesBefore;
+  }
+
+  std::printf(
+      "{\"name\":\"%s\",\"width\":%u,\"height\":%u,\"density\":%.4f,\"mines\":%lu,\"operations\":%zu,"
+      "\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f,\"bytes_per_op\":%.1f,\"peak_rss_kb\":%ld}\n",
+      name.c_str(), board.width, board.height, board.density, board.mineCount(), operations,
+      (double)elapsed.count() / operations, (double)allocations / operations, (double)bytes / operations,
+      peakResidentKilobytes());
+  std::fflush(stdout);
+}
+
+// Keeps results alive so the optimiser cannot drop the work that produced them
+static volatile size_t sink;
+
+// Chord every revealed number whose neighbours are all flagged, returning how many chords were made
+static size_t chordAll(minesweeper::game& game) {
+  const auto grid = game.getGrid();
+  size_t chords = 0, opened = 0;
+
+  for (size_t row = 0; row < game.height(); ++row) {
+    for (size_t col = 0; col < game.width(); ++col) {
+      const auto& t = grid(row, col);
+      if (t.isRevealed() && t.adjacentMineCount() != 0 && game.adjacentFlagCount(row, col) == t.adjacentMineCount()) {
+        opened += game.chord(row, col);
+        ++chords;
+      }
+    }
+  }
+
+  sink = sink + opened;
+  return chords;
+}
+
+// Play a game with perfect knowledge of the mines: flag every mine next to a revealed number and chord it,
+// falling back to revealing the next hidden safe tile when nothing can be chorded
+static void playScripted(minesweeper::game& game) {
+  const auto grid = game.getGrid();
+
+  game.reveal(game.height() / 2, game.width() / 2);
+
+  size_t nextHidden = 0;
+  while (game.state() == minesweeper::game::status::PLAYING) {
+    bool progress = false;
+
+    for (size_t row = 0; row < game.height(); ++row) {
+      for (size_t col = 0; col < game.width(); ++col) {
+        const auto& t = grid(row, col);
+        if (!t.isRevealed() || t.adjacentMineCount() == 0) {
+          continue;
+        }
+
+        bool hidden = false;
+        game.forEachNeighbour(row, col, [&](size_t neighbourRow, size_t neighbourCol) {
+          const auto& n = grid(neighbourRow, neighbourCol);
+          if (n.isMine() && !n.isFlagged()) {
+            game.flag(neighbourRow, neighbourCol);
+          }
+          hidden |= !n.isMine() && !n.isRevealed();
+        });
+
+        if (hidden) {
+          game.reveal(row, col);
+          progress = true;
+        }
+      }
+    }
+
+    if (!progress) {
+      for (; nextHidden < game.width() * game.height(); ++nextHidden) {
+        const auto& t = grid(nextHidden / game.width(), nextHidden % game.width());
+        if (!t.isRevealed() && !t.isMine()) {
+          game.reveal(nextHidden);
+          break;
+        }
+      }
+    }
+  }
+}
+
+// Apply each round of deductions as one batch until the solver has nothing more to offer
+static void solveAll(minesweeper::game& game, minesweeper::solver& solver) {
+  for (const auto* found = &solver.solve(); !found->empty(); found = &solver.solve()) {
+    game.beginBatch();
+    for (unsigned long int position : found->mines) {
+      game.flag(position);
+    }
+    for (unsigned long int position : found->safe) {
+      game.reveal(position);
+    }
+    solver.update(game.commit());
+  }
+}
+
+// The simulate case again on a game whose size is fixed at compile time, when the board has that size
+template<unsigned int W, unsigned int H>
+static void simulateFixed(const Options& options, const Board& board) {
+  using fixed = minesweeper::fixed_game<W, H>;
+
+  if (board.width == W && board.height == H) {
+    run(options, "simulate_fixed/" + board.name(), board, [] {}, [&] {
+      return minesweeper::simulate<fixed>(W, H, board.mineCount(), 10'000, minesweeper::solver_strategy<fixed>()).games;
+    });
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+
+    if (argument.starts_with("--filter=")) {
+      options.filter = argument.substr(9);
+    } else if (argument.starts_with("--min-time=")) {
+      options.minTime = std::atof(argument.c_str() + 11);
+    } else if (argument.starts_with("--max-tiles=")) {
+      options.maxTiles = std::strtoull(argument.c_str() + 12, nullptr, 10);
+    } else {
+      std::fprintf(stderr, "USAGE: %s [--filter=substring] [--min-time=seconds] [--max-tiles=count]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const std::vector<std::pair<unsigned int, unsigned int>> sizes = {
+    {9, 9}, {16, 16}, {30, 16}, {100, 100}, {1000, 1000}, {10000, 10000}
+  };
+  const std::vector<double> densities = {0.01, 0.10, 0.20625, 0.50, 0.95};
+
+  for (const auto& [width, height] : sizes) {
+    for (double density : densities) {
+      const Board board{width, height, density};
+      minesweeper::game game(width, height, board.mineCount());
+
+      run(options, "initialise/" + board.name(), board, [] {}, [&] {
+        game.initialise(width, height, board.mineCount());
+        return 1;
+      });
+
+      run(options, "first_click/" + board.name(), board, [&] {
+        game.initialise(width, height, board.mineCount());
+      }, [&] {
+        game.reveal(height / 2, width / 2);
+        return 1;
+      });
+
+      run(options, "flag/" + board.name(), board, [] {}, [&] {
+        for (unsigned int col = 0; col < width; ++col) {
+          game.flag(height / 2, col);
+        }
+        return width;
+      });
+
+      run(options, "state/" + board.name(), board, [] {}, [&] {
+        for (int i = 0; i < 1000; ++i) {
+          sink = sink + game.isAllExceptMinesRevealed();
+        }
+        return 1000;
+      });
+
+      // Flag every mine after the first click, then time chording the numbers they surround
+      if ((size_t)width * height <= 1'000'000) {
+        run(options, "chord/" + board.name(), board, [&] {
+          game.initialise(width, height, board.mineCount());
+          game.reveal(height / 2, width / 2);
+
+          const auto grid = game.getGrid();
+          for (size_t position = 0; position < (size_t)width * height; ++position) {
+            if (grid(position / width, position % width).isMine()) {
+              game.flag(position);
+            }
+          }
+        }, [&] {
+          return std::max<size_t>(chordAll(game), 1);
+        });
+      }
+
+      // Clear as much of the board as deduction alone allows
+      if ((size_t)width * height <= 1'000'000) {
+        run(options, "solve/" + board.name(), board, [&] {
+          game.initialise(width, height, board.mineCount());
+        }, [&] {
+          minesweeper::solver solver(game);
+          solver.update(game.reveal(height / 2, width / 2));
+          solveAll(game, solver);
+          return 1;
+        });
+      }
+
+      // Exact mine chances once deduction has got as far as it can
+      if ((size_t)width * height <= 1'000'000) {
+        std::optional<minesweeper::solver> solver;
+        run(options, "probabilities/" + board.name(), board, [&] {
+          game.initialise(width, height, board.mineCount());
+          solver.emplace(game);
+          solver->update(game.reveal(height / 2, width / 2));
+          solveAll(game, *solver);
+        }, [&] {
+          sink = sink + solver->probabilities().size();
+          return 1;
+        });
+      }
+
+      // Boards which need no guessing are rare on large or dense boards, so only deal them for the classic sizes
+      if ((size_t)width * height <= 30 * 16 && density <= 0.25) {
+        run(options, "no_guess/" + board.name(), board, [&] {
+          game.initialise(width, height, board.mineCount());
+        }, [&] {
+          minesweeper::revealWithoutGuessing(game, height / 2, width / 2);
+          return 1;
+        });
+      }
+
+      // Whole games on every core, played by deduction with random guesses
+      if ((size_t)width * height <= 30 * 16) {
+        run(options, "simulate/" + board.name(), board, [] {}, [&] {
+          return minesweeper::simulate(width, height, board.mineCount(), 10'000, minesweeper::solver_strategy()).games;
+        });
+
+        simulateFixed<9, 9>(options, board);
+        simulateFixed<16, 16>(options, board);
+        simulateFixed<30, 16>(options, board);
+      }
+
+      // Saving writes every tile, while loading maps them and only reads the border, so it grows with the sides of the
+      // board rather than its area. Verifying reads every tile again.
+      if (density == 0.20625) {
+        const std::string path = (std::filesystem::temp_directory_path() / "mines-bench.sav").string();
+
+        run(options, "save/" + board.name(), board, [&] {
+          game.initialise(width, height, board.mineCount());
+          game.reveal(height / 2, width / 2);
+        }, [&] {
+          game.save(path);
+          return 1;
+        });
+
+        run(options, "load/" + board.name(), board, [&] {
+          if (!std::filesystem::exists(path)) {
+            game.save(path);
+          }
+        }, [&] {
+          sink = sink + minesweeper::game::load(path).revealedCount();
+          return 1;
+        });
+
+        run(options, "load_verified/" + board.name(), board, [&] {
+          if (!std::filesystem::exists(path)) {
+            game.save(path);
+          }
+        }, [&] {
+          sink = sink + minesweeper::game::load(path, true).revealedCount();
+          return 1;
+        });
+
+        std::filesystem::remove(path);
+      }
+
+      // Play back a recorded game which reveals every safe tile in turn, without drawing anything
+      if ((size_t)width * height <= 1'000'000) {
+        std::optional<minesweeper::replay> recording;
+        run(options, "replay/" + board.name(), board, [&] {
+          if (!recording) {
+            recording.emplace(1, width, height, board.mineCount());
+            recording->deal(game);
+
+            const auto grid = game.getGrid();
+            for (size_t position = 0; position < (size_t)width * height && game.state() == minesweeper::game::status::PLAYING; ++position) {
+              const auto& t = grid(position / width, position % width);
+              if (!t.isRevealed() && !t.isMine()) {
+                recording->reveal(game, position);
+              }
+            }
+          }
+
+          recording->deal(game);
+        }, [&] {
+          minesweeper::replay::player(*recording).fastForward(game);
+          return 1;
+        });
+      }
+
+      // Scripted games rescan the board after every pass, so only play them on the smaller boards
+      if ((size_t)width * height <= 10'000) {
+        run(options, "scripted_game/" + board.name(), board, [&] {
+          game.initialise(width, height, board.mineCount());
+        }, [&] {
+          playScripted(game);
+          return 1;
+        });
+      }
+    }
+  }
+
+  // Endless chunked boards, where the cost follows the area a first click opens rather than the size of the board
+  for (double density : densities) {
+    const Board board{0, 0, density};
+    std::optional<minesweeper::chunked_game> game;
+    std::uint64_t seed = 0;
+
+    run(options, "chunked_first_click/endless/" + std::to_string((int)(density * 100 + 0.5)) + '%', board, [&] {
+      game.emplace(++seed, density);
+    }, [&] {
+      game->reveal(0, 0);
+      return 1;
+    });
+  }
+
+  return 0;
+}
+
+// vim: ts=2:sw=2:expandtab
@@ -1,16 +1,20 @@
 #include "../include/mines.hpp"
 #include <chrono>
 #include <format>
+#include <optional>
+#include <QtCore/QHash>
 #include <QtCore/QTimer>
 #include <QtGui/QIcon>
 #include <QtGui/QMouseEvent>
+#include <QtGui/QPainter>
+#include <QtGui/QPaintEvent>
+#include <QtGui/QPixmap>
 #include <QShortcut>
 #include <QStyle>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QFrame>
 #include <QtWidgets/QGraphicsBlurEffect>
 #include <QtWidgets/QGraphicsColorizeEffect>
-#include <QtWidgets/QGridLayout>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QMenu>
@@ -21,83 +25,289 @@
 
 class MinesweeperWindow : public QMainWindow {
 public:
-    class Tile : public QPushButton {
+    // The whole board as a single widget, painted from cached pixmaps of a prototype tile button so the stylesheet still applies
+    class Minefield : public QWidget {
     public:
-        Tile(const QIcon& icon, const QString& str, MinesweeperWindow* parentWindow, size_t row, size_t col)
-            : QPushButton(icon, str), row(row), col(col), parentWindow(parentWindow) {
-            this->setAutoFillBackground(true);
+        Minefield(MinesweeperWindow* parentWindow)
+            : QWidget(), parentWindow(parentWindow) {
+            prototype.setProperty("class", "tile");
+            prototype.setAttribute(Qt::WA_DontShowOnScreen);
         }
 
-        Tile(const QString& str, MinesweeperWindow* parentWindow, size_t row, size_t col)
-            : Tile(QIcon(), str, parentWindow, row, col) {}
-
-        virtual ~Tile() {}
+        virtual ~Minefield() {}
 
         virtual bool hasHeightForWidth() const override {
             return true;
         }
         virtual int heightForWidth(int w) const override {
-            return w;
+            return w * (int) parentWindow->game.height() / (int) parentWindow->game.width();
+        }
+
+        virtual QSize sizeHint() const override {
+            return QSize((int) parentWindow->game.width() * 24, (int) parentWindow->game.height() * 24);
+        }
+        virtual QSize minimumSizeHint() const override {
+            return QSize((int) parentWindow->game.width() * 4, (int) parentWindow->game.height() * 4);
+        }
+
+        // Called when the board has been reinitialised, possibly with a different size
+        void resetBoard() {
+            pressed.reset();
+            this->updateGeometry();
+            this->update();
+        }
+
+        void updateTiles(const minesweeper::game::change_set& changes) {
+            for (const auto& run : changes.runs()) {
+                this->update(this->tileRect(run.row, run.col).united(this->tileRect(run.row, run.col + run.length - 1)));
+            }
+        }
+
+        virtual void paintEvent(QPaintEvent* event) override {
+            const minesweeper::game& game = parentWindow->game;
+            const auto board = game.getGrid();
+            const int pitch = this->pitch();
+            const QPoint origin = this->origin();
+
+            if (pitch != cachedPitch) {
+                pixmaps.clear();
+                cachedPitch = pitch;
+                this->prerender(pitch - 1);
+            }
+
+            // Only paint the tiles inside the area being repainted
+            const QRect area = event->rect().translated(-origin).intersected(QRect(0, 0, pitch * (int) game.width(), pitch * (int) game.height()));
+            if (area.isEmpty()) {
+                return;
+            }
+
+            QPainter painter(this);
+            for (size_t row = area.top() / pitch; row <= (size_t)(area.bottom() / pitch); ++row) {
+                for (size_t col = area.left() / pitch; col <= (size_t)(area.right() / pitch); ++col) {
+                    const QPoint corner = origin + QPoint((int) col * pitch, (int) row * pitch);
+                    painter.drawPixmap(corner, this->pixmapFor(this->lookAt(board, row, col), pitch - 1));
+                }
+            }
         }
 
         virtual void mousePressEvent(QMouseEvent* event) override {
-            if (parentWindow->gameState == GameState::NONE) {
-                if (parentWindow->game.getGrid().at(row).at(col).isRevealed()) {
-                    for (int rowOffset = -1; rowOffset <= 1; ++rowOffset) {
-                        for (int colOffset = -1; colOffset <= 1; ++colOffset) {
-                            if (rowOffset == 0 && colOffset == 0) {
-                                continue;
-                            }
-
-                            try {
-                                Tile& t = *parentWindow->grid.at(row + rowOffset).at(col + colOffset);
-                                if (!t.isFlat()) {
-                                    t.setDown(true);
-                                }
-                            } catch (const std::out_of_range&) {
-                                continue;
-                            }
-                        }
-                    }
+            size_t row = 0, col = 0;
+            if (parentWindow->gameState == GameState::PLAYING && this->tileAt(event->pos(), row, col)) {
+                // Press down the tiles surrounding a revealed tile
+                if (parentWindow->game.getGrid()(row, col).isRevealed()) {
+                    pressed.emplace(row, col);
+                    this->updateAround(row, col);
                 }
 
                 if (event->button() == Qt::LeftButton || event->button() == Qt::MiddleButton) {
-                    parentWindow->game.reveal(row, col);
+                    parentWindow->updateGrid(parentWindow->game.reveal(row, col));
                 } else if (event->button() == Qt::RightButton) {
-                    parentWindow->game.flag(row, col);
+                    parentWindow->updateGrid(parentWindow->game.flag(row, col));
                 }
-
-                parentWindow->updateGrid();
-                parentWindow->repaint();
             }
 
-            QPushButton::mousePressEvent(event);
+            QWidget::mousePressEvent(event);
         }
 
         virtual void mouseReleaseEvent(QMouseEvent* event) override {
-            for (int rowOffset = -1; rowOffset <= 1; ++rowOffset) {
-                for (int colOffset = -1; colOffset <= 1; ++colOffset) {
-                    if (rowOffset == 0 && colOffset == 0) {
-                        continue;
-                    }
-
-                    try {
-                        parentWindow->grid.at(row + rowOffset).at(col + colOffset)->setDown(false);
-                    } catch (const std::out_of_range&) {
-                        continue;
-                    }
+            if (pressed) {
+                this->updateAround(pressed->first, pressed->second);
+                pressed.reset();
+            }
+
+            QWidget::mouseReleaseEvent(event);
+        }
+
+    private:
+        enum struct Icon : uint8_t {
+            NONE = 0,
+            FLAG = 1,
+            FLAG_GREEN = 2,
+            FLAG_RED = 3,
+            BOMB = 4
+        };
+
+        // Everything that decides how a tile is drawn
+        struct Look {
+            uint8_t type = 0;
+            bool mine = false;
+            bool flagged = false;
+            bool revealed = false;
+            bool gameOver = false;
+            bool flat = false;
+            bool down = false;
+            bool checked = false;
+            bool disabled = false;
+            Icon icon = Icon::NONE;
+
+            uint32_t key() const {
+                return this->styleKey() | flat << 8 | down << 9 | checked << 10 | disabled << 11 | static_cast<uint32_t>(icon) << 12;
+            }
+
+            // The part of the key matched by the stylesheet's property selectors
+            uint32_t styleKey() const {
+                return type | mine << 4 | flagged << 5 | revealed << 6 | gameOver << 7;
+            }
+        };
+
+        Look lookAt(const minesweeper::game::grid_view& board, size_t row, size_t col) const {
+            const auto& t = board(row, col);
+            const bool playing = parentWindow->gameState == GameState::PLAYING;
+
+            Look look;
+            look.type = t.adjacentMineCount();
+            look.mine = t.isMine();
+            look.flagged = t.isFlagged();
+            look.revealed = t.isRevealed();
+            look.disabled = parentWindow->timer.isPaused();
+
+            if (t.isFlagged()) {
+                if (!playing) {
+                    look.icon = t.isMine() ? Icon::FLAG_GREEN : Icon::FLAG_RED;
+                } else {
+                    look.icon = Icon::FLAG;
+                }
+            }
+
+            if (t.isRevealed()) {
+                look.flat = true;
+
+                if (t.isMine()) {
+                    look.icon = Icon::BOMB;
+                    look.flat = false;
+                    look.checked = true;
+                }
+            } else if (!playing) {
+                // When game is over
+                look.gameOver = true;
+
+                // Mine
+                if (t.isMine() && !t.isFlagged()) {
+                    look.icon = Icon::BOMB;
+                    look.disabled = true;
+                }
+            }
+
+            if (pressed && !look.flat && (row != pressed->first || col != pressed->second) &&
+                    row + 1 >= pressed->first && row <= pressed->first + 1 && col + 1 >= pressed->second && col <= pressed->second + 1) {
+                look.down = true;
+            }
+
+            return look;
+        }
+
+        // Render a look with the prototype button the first time it is needed at the current size
+        const QPixmap& pixmapFor(const Look& look, int size) {
+            auto cached = pixmaps.constFind(look.key());
+            if (cached != pixmaps.constEnd()) {
+                return *cached;
+            }
+
+            prototype.resize(size, size);
+            prototype.setIcon(this->iconFor(look.icon));
+            prototype.setText(look.revealed && !look.mine && look.type != 0 ? QString::number(look.type) : QString());
+            prototype.setFlat(look.flat);
+            prototype.setDown(look.down);
+            prototype.setCheckable(look.checked);
+            prototype.setChecked(look.checked);
+            prototype.setDisabled(look.disabled);
+
+            // Only re-polish when a property the stylesheet can select on has changed
+            if (look.styleKey() != polishedStyle) {
+                if (look.mine) {
+                    prototype.setProperty("type", "mine");
+                } else {
+                    prototype.setProperty("type", (int) look.type);
                 }
+                prototype.setProperty("flagged", look.flagged ? "true" : "false");
+                prototype.setProperty("revealed", look.revealed ? "true" : "false");
+                prototype.setProperty("gameOver", look.gameOver ? "true" : "false");
+
+                // Update styles
+                prototype.style()->unpolish(&prototype);
+                prototype.style()->polish(&prototype);
+                polishedStyle = look.styleKey();
             }
 
-            QPushButton::mouseReleaseEvent(event);
+            return *pixmaps.insert(look.key(), prototype.grab());
+        }
+
+        const QIcon& iconFor(Icon icon) const {
+            static const QIcon none;
+
+            switch (icon) {
+                case Icon::FLAG:
+                    return parentWindow->icons.flag;
+                case Icon::FLAG_GREEN:
+                    return parentWindow->icons.flagGreen;
+                case Icon::FLAG_RED:
+                    return parentWindow->icons.flagRed;
+                case Icon::BOMB:
+                    return parentWindow->icons.bomb;
+                case Icon::NONE:
+                    break;
+            }
 
-            this->setChecked(true);
+            return none;
         }
 
+        // Render the looks of hidden and revealed tiles up front, so the first large reveal at a new size does not stall
+        void prerender(int size) {
+            Look hidden;
+            this->pixmapFor(hidden, size);
+
+            Look revealed;
+            revealed.revealed = true;
+            revealed.flat = true;
+            for (uint8_t type = 0; type <= 8; ++type) {
+                revealed.type = type;
+                this->pixmapFor(revealed, size);
+            }
+        }
+
+        // Distance between neighbouring tiles, including a one pixel gap
+        int pitch() const {
+            const minesweeper::game& game = parentWindow->game;
+            return std::max(2, std::min((this->width() + 1) / (int)game.width(), (this->height() + 1) / (int)game.height()));
+        }
+
+        // Top left corner of the board, which is centred in the widget
+        QPoint origin() const {
+            const minesweeper::game& game = parentWindow->game;
+            const int pitch = this->pitch();
+            return QPoint((this->width() + 1 - pitch * (int)game.width()) / 2, (this->height() + 1 - pitch * (int)game.height()) / 2);
+        }
+
+        QRect tileRect(size_t row, size_t col) const {
+            const int pitch = this->pitch();
+            return QRect(this->origin() + QPoint((int) col * pitch, (int) row * pitch), QSize(pitch - 1, pitch - 1));
+        }
+
+        bool tileAt(const QPoint& position, size_t& row, size_t& col) const {
+            const QPoint offset = position - this->origin();
+            const int pitch = this->pitch();
+            if (offset.x() < 0 || offset.y() < 0) {
+                return false;
+            }
+
+            row = offset.y() / pitch;
+            col = offset.x() / pitch;
+            return row < parentWindow->game.height() && col < parentWindow->game.width();
+        }
+
+        void updateAround(size_t row, size_t col) {
+            const size_t lastRow = std::min(row + 1, parentWindow->game.height() - 1);
+            const size_t lastCol = std::min(col + 1, parentWindow->game.width() - 1);
+            this->update(this->tileRect(row > 0 ? row - 1 : 0, col > 0 ? col - 1 : 0).united(this->tileRect(lastRow, lastCol)));
+        }
 
     private:
-        const size_t row = 0, col = 0;
         MinesweeperWindow* parentWindow;
+        QPushButton prototype;
+        QHash<uint32_t, QPixmap> pixmaps;
+        int cachedPitch = 0;
+        std::optional<uint32_t> polishedStyle;
+        std::optional<std::pair<size_t, size_t>> pressed;
     };
 
     class RestartButton : public QPushButton {
@@ -169,6 +379,13 @@ public:
             QTimer::stop();
         }
 
+        // Carry on counting from the time stop() left off at
+        void resume() {
+            startTime = std::chrono::high_resolution_clock::now() - lastDuration;
+
+            QTimer::start();
+        }
+
         virtual void timerEvent(QTimerEvent*) override {
             setDuration();
         }
@@ -193,22 +410,19 @@ public:
         bool paused = false;
     };
 
-    enum struct GameState : uint8_t {
-        NONE = 0,
-        WON = 1,
-        LOST = 2
-    };
+    using GameState = minesweeper::game::status;
 
 public:
     //9x9: 10
     //16x16: 40
     //30x16: 99
     MinesweeperWindow() : QMainWindow(), game(30, 16, 99) {
-        gridLayout.setSpacing(1);
+        game.setUndoHistory(true);
+
         flagLabel.setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
         restartButton.setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
         timeLabel.setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
-        gridFrame.setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
+        minefield.setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
         pausedIcon.setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
 
         // Create a central widget
@@ -231,12 +445,9 @@ public:
 
         stackLayout.addWidget(&pausedIcon);
 
-        // Create the grid for the board
-        gridLayout.setContentsMargins(0, 0, 0, 0);
-        gridFrame.setLayout(&gridLayout);
-
-        stackLayout.addWidget(&gridFrame);
-        stackLayout.setCurrentWidget(&gridFrame);
+        // Add the board itself
+        stackLayout.addWidget(&minefield);
+        stackLayout.setCurrentWidget(&minefield);
 
         resizeGrid();
 
@@ -246,6 +457,10 @@ public:
         // Shortcut to restart game
         QObject::connect(&shortcut, &QShortcut::activated, this, static_cast<void (MinesweeperWindow::*)(void)>(&MinesweeperWindow::restartGame));
 
+        // Shortcuts to undo and redo moves
+        QObject::connect(&undoShortcut, &QShortcut::activated, this, &MinesweeperWindow::undoMove);
+        QObject::connect(&redoShortcut, &QShortcut::activated, this, &MinesweeperWindow::redoMove);
+
         // Show the window
         centralWidget.setLayout(&mainLayout);
     }
@@ -263,42 +478,33 @@ protected:
         this->restartGame(game.width(), game.height(), game.mineCount());
     }
 
+    // Moves can be taken back while the game is being played, and so can the one that lost it
+    void undoMove() {
+        if (gameState != GameState::WON && !timer.isPaused()) {
+            const bool lost = gameState == GameState::LOST;
+            const minesweeper::game::change_set& changes = game.undo();
+
+            // The clock carries on from where the loss stopped it
+            if (lost && game.state() == GameState::PLAYING) {
+                timer.resume();
+            }
+            this->updateGrid(changes);
+        }
+    }
+
+    void redoMove() {
+        if (gameState == GameState::PLAYING && !timer.isPaused()) {
+            this->updateGrid(game.redo());
+        }
+    }
+
     void playPauseGame() {
         timer.playPause();
         this->updateGrid();
     }
 
     void resizeGrid() {
-        static QSizePolicy tilePolicy(QSizePolicy::Preferred, QSizePolicy::Ignored);
-        tilePolicy.setWidthForHeight(true);
-
-        // Delete tiles from grid
-        QLayoutItem* item = nullptr;
-        while ((item = gridLayout.takeAt(0)) != nullptr) {
-            gridLayout.removeWidget(item->widget());
-            gridLayout.removeItem(item);
-            delete item->widget();
-            delete item;
-        }
-
-        // Add new tiles to grid
-        grid.clear();
-        grid.resize(game.height());
-        for (size_t row = 0; row < game.height(); ++row) {
-            grid.at(row).reserve(game.width());
-
-            for (size_t col = 0; col < game.width(); ++col) {
-                Tile* tile = new Tile("", this, row, col);
-                tile->setSizePolicy(tilePolicy);
-                tile->setProperty("class", "tile");
-                tile->ensurePolished();
-
-                gridLayout.addWidget(tile, row, col);
-                tile->show();
-
-                grid[row].push_back(tile);
-            }
-        }
+        minefield.resetBoard();
 
         this->timer.stop();
         this->timeLabel.setText("00:00:00");
@@ -307,123 +513,81 @@ protected:
     }
 
     void updateGrid() {
-        // Set restart button face
-        if (this->game.isAllExceptMinesRevealed()) {
-            restartButton.setIcon(QIcon::fromTheme("face-cool"));
-            gameState = GameState::WON;
-        } else if (this->game.isMineRevealed()) {
-            restartButton.setIcon(QIcon::fromTheme("face-sad"));
-            gameState = GameState::LOST;
-        } else {
-            restartButton.setIcon(QIcon::fromTheme("face-smile"));
-            gameState = GameState::NONE;
-        }
-
-        const auto& board = game.getGrid();
-
-        // Apply blur if game is paused
-        if (timer.isPaused()) {
-            QGraphicsBlurEffect* blur = new QGraphicsBlurEffect();
-            blur->setBlurHints(QGraphicsBlurEffect::PerformanceHint);
-            blur->setBlurRadius(20);
-
-            gridFrame.setGraphicsEffect(blur);
-
-            stackLayout.setCurrentWidget(&pausedIcon);
-            stackLayout.setStackingMode(QStackedLayout::StackAll);
-        } else {
-            gridFrame.setGraphicsEffect(nullptr);
+        this->updateStatus();
+        minefield.update();
+    }
 
-            stackLayout.setCurrentWidget(&gridFrame);
-            stackLayout.setStackingMode(QStackedLayout::StackOne);
+    // Only restyle the tiles changed by an action, unless it ended the game
+    void updateGrid(const minesweeper::game::change_set& changes) {
+        if (changes.stateChanged()) {
+            this->updateGrid();
+            return;
         }
 
-        bool revealed = false;
-        for (size_t row = 0; row < game.height(); ++row) {
-            for (size_t col = 0; col < game.width(); ++col) {
-                const auto& t = board.at(row).at(col);
-                Tile& tile = *grid.at(row).at(col);
-
-                // Default empty
-                tile.setIcon(QIcon());
-                tile.setText("");
-
-                if (timer.isPaused()) {
-                    tile.setDisabled(true);
-                } else {
-                    tile.setDisabled(false);
-                }
+        this->updateStatus();
+        minefield.updateTiles(changes);
+    }
 
-                tile.setFlat(false);
-                tile.setProperty("type", "");
+    void updateStatus() {
+        // Set restart button face, only when it changes
+        gameState = this->game.state();
+        if (shownState != gameState) {
+            switch (gameState) {
+                case GameState::WON:
+                    restartButton.setIcon(icons.faceCool);
+                    break;
+                case GameState::LOST:
+                    restartButton.setIcon(icons.faceSad);
+                    break;
+                case GameState::PLAYING:
+                    restartButton.setIcon(icons.faceSmile);
+                    break;
+            }
+            shownState = gameState;
+        }
 
-                if (t.isMine()) {
-                    tile.setProperty("type", "mine");
-                } else {
-                    tile.setProperty("type", t.adjacentMineCount());
-                }
+        // Apply blur if game is paused, only when pausing or resuming
+        if (shownPaused != timer.isPaused()) {
+            if (timer.isPaused()) {
+                QGraphicsBlurEffect* blur = new QGraphicsBlurEffect();
+                blur->setBlurHints(QGraphicsBlurEffect::PerformanceHint);
+                blur->setBlurRadius(20);
 
-                if (t.isFlagged()) {
-                    // Flagged
-                    tile.setProperty("flagged", "true");
-
-                    if (gameState != GameState::NONE) {
-                        if (t.isMine()) {
-                            tile.setIcon(QIcon::fromTheme("flag-green"));
-                        } else {
-                            tile.setIcon(QIcon::fromTheme("flag-red"));
-                        }
-                    } else {
-                        tile.setIcon(QIcon::fromTheme("flag"));
-                    }
-                    tile.setFlat(false);
-                } else {
-                    tile.setProperty("flagged", "false");
-                }
+                minefield.setGraphicsEffect(blur);
 
-                if (t.isRevealed()) {
-                    revealed = true;
-
-                    // Revealed class
-                    tile.setProperty("revealed", "true");
-
-                    tile.setFlat(true);
-
-                    if (t.isMine()) {
-                        tile.setIcon(QIcon::fromTheme("edit-bomb"));
-                        tile.setFlat(false);
-                        tile.setCheckable(true);
-                    } else if (t.adjacentMineCount() != 0) {
-                        tile.setText(QString::fromStdString(std::string(1, (char) board.at(row).at(col))));
-                    }
-                } else if (gameState != GameState::NONE) {
-                    // When game is over
-                    tile.setProperty("gameOver", "true");
-
-                    // Mine
-                    if (t.isMine() && !t.isFlagged()) {
-                        tile.setIcon(QIcon::fromTheme("edit-bomb"));
-                        tile.setFlat(false);
-                        tile.setDisabled(true);
-                    }
-                }
+                stackLayout.setCurrentWidget(&pausedIcon);
+                stackLayout.setStackingMode(QStackedLayout::StackAll);
+            } else {
+                minefield.setGraphicsEffect(nullptr);
 
-                // Update styles
-                tile.style()->unpolish(&tile);
-                tile.style()->polish(&tile);
+                stackLayout.setCurrentWidget(&minefield);
+                stackLayout.setStackingMode(QStackedLayout::StackOne);
             }
+            shownPaused = timer.isPaused();
         }
 
-        if (revealed && !timer.isActive()) {
+        if (game.revealedCount() != 0 && !timer.isActive()) {
             timer.start();
-        } else if (gameState != GameState::NONE) {
+        } else if (gameState != GameState::PLAYING) {
             timer.stop();
         }
         this->flagLabel.setText(QString::fromStdString(std::to_string(game.flagCount()) + '/' + std::to_string(game.mineCount())));
     }
 
 protected:
+    // Theme icons are looked up once per window rather than on every update
+    struct Icons {
+        QIcon flag = QIcon::fromTheme("flag");
+        QIcon flagGreen = QIcon::fromTheme("flag-green");
+        QIcon flagRed = QIcon::fromTheme("flag-red");
+        QIcon bomb = QIcon::fromTheme("edit-bomb");
+        QIcon faceCool = QIcon::fromTheme("face-cool");
+        QIcon faceSad = QIcon::fromTheme("face-sad");
+        QIcon faceSmile = QIcon::fromTheme("face-smile");
+    };
+
     minesweeper::game game;
+    const Icons icons;
     QVBoxLayout& mainLayout = *new QVBoxLayout();
 
     // Minesweeper grid
@@ -433,8 +597,7 @@ protected:
     QStackedLayout& stackLayout = *new QStackedLayout();
     QPushButton& pausedIcon = *new QPushButton();
 
-    QFrame& gridFrame = *new QFrame();
-    QGridLayout& gridLayout = *new QGridLayout();
+    Minefield& minefield = *new Minefield(this);
 
     QLabel& flagLabel = *new QLabel();
 
@@ -443,6 +606,8 @@ protected:
 
     RestartButton& restartButton = *new RestartButton("", this);
     QShortcut& shortcut = *new QShortcut(QKeySequence(Qt::Key_Space), this);
+    QShortcut& undoShortcut = *new QShortcut(QKeySequence::Undo, this);
+    QShortcut& redoShortcut = *new QShortcut(QKeySequence::Redo, this);
 
     SettingsButton& settingsButton = *new SettingsButton(QIcon::fromTheme("configure"), "", this);
 
@@ -450,8 +615,9 @@ protected:
     GameTimer& timer = *new GameTimer(this);
     QLabel& timeLabel = *new QLabel();
 
-    GameState gameState = GameState::NONE;
-    std::vector<std::vector<Tile*>> grid;
+    GameState gameState = GameState::PLAYING;
+    std::optional<GameState> shownState;
+    std::optional<bool> shownPaused;
 };
 
 int main(int argc, char* argv[]) {
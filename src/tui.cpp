@@ -1,8 +1,17 @@
 #include "../include/mines.hpp"
+#include "../include/noguess.hpp"
+#include "../include/replay.hpp"
 #include <algorithm>
 #include <array>
 #include <cctype>
 #include <iostream>
+#include <csignal>
+#include <optional>
+#include <random>
+#include <string>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
 
 static const std::array<std::string, 9> NUMCOLOURS = {
   "",
@@ -16,6 +25,317 @@ static const std::array<std::string, 9> NUMCOLOURS = {
   "\033[37m"
 };
 
+static const std::string RED_BACKGROUND = "\033[41m";
+static const std::string GREEN_BACKGROUND = "\033[42m";
+static const std::string SELECTED_BACKGROUND = "\033[100m";
+
+// Milliseconds the input loops wait for keys before going round again, drawing only when something has changed
+static constexpr int FRAME_TIME = 100;
+
+// How a single board cell appears on screen
+struct Cell {
+  // '#' stands for a hidden tile, anything else is printed as is
+  char glyph = '#';
+  const std::string* colour = &NUMCOLOURS[0];
+  bool selected = false;
+
+  bool operator==(const Cell&) const = default;
+};
+
+static Cell playingCell(const minesweeper::game::tile& t) {
+  if (!t.isRevealed() && !t.isFlagged()) {
+    return Cell{'#'};
+  } else if (t.isFlagged()) {
+    return Cell{'F'};
+  } else if (t.isMine()) {
+    return Cell{'*', &RED_BACKGROUND};
+  } else {
+    return Cell{(char) t, &NUMCOLOURS[t.adjacentMineCount()]};
+  }
+}
+
+static Cell finalCell(const minesweeper::game::tile& t) {
+  if (t.isFlagged()) {
+    return Cell{'F', t.isMine() ? &GREEN_BACKGROUND : &RED_BACKGROUND};
+  } else if (t.isMine()) {
+    return Cell{'*', t.isRevealed() ? &RED_BACKGROUND : &NUMCOLOURS[0]};
+  } else if (t.isRevealed()) {
+    return Cell{(char) t, &NUMCOLOURS[t.adjacentMineCount()]};
+  } else {
+    return Cell{'#'};
+  }
+}
+
+// Draws frames by comparing them against the previous one, moving the cursor only to the cells that changed.
+// Only the tiles marked since the last frame are looked at, so the work follows what changed rather than the size of
+// the board. Each frame is built in one buffer and written with a single system call.
+class Screen {
+  public:
+    // Look at the tiles an action changed at the next frame
+    void mark(const minesweeper::game::change_set& changes) {
+      this->dirty.insert(this->dirty.end(), changes.runs().begin(), changes.runs().end());
+    }
+
+    void mark(size_t row, size_t col) {
+      this->dirty.push_back({row, col, 1});
+    }
+
+    // Look at every tile at the next frame, for a new board or a new way of drawing its cells
+    void invalidate() {
+      this->stale = true;
+    }
+
+    template<typename CellFunction>
+    void draw(const minesweeper::game& game, const std::string& header, const std::string& footer, CellFunction&& cellFunction) {
+      const auto grid = game.getGrid();
+      const size_t width = game.width();
+
+      this->buffer.clear();
+      this->cursor = SIZE_MAX;
+
+      // Redraw everything if the board changed shape
+      const bool full = this->cells.size() != width * game.height() || this->shownWidth != width;
+      if (full) {
+        this->buffer += "\033[2J";
+        this->cells.assign(width * game.height(), Cell{});
+      }
+
+      if (full || header != this->shownHeader) {
+        moveTo(1, 1);
+        this->buffer += header;
+        this->buffer += "\033[K";
+      }
+
+      // Write the cells that look different from what is on screen
+      const auto drawCell = [&](size_t row, size_t col) {
+        const Cell cell = cellFunction(grid(row, col), row, col);
+        Cell& shown = this->cells[row * width + col];
+        if (full || cell != shown) {
+          shown = cell;
+          this->writeCell(cell, row * width + col, width);
+        }
+      };
+
+      if (full || this->stale) {
+        for (size_t row = 0; row < game.height(); ++row) {
+          for (size_t col = 0; col < width; ++col) {
+            drawCell(row, col);
+          }
+        }
+      } else {
+        for (const auto& run : this->dirty) {
+          for (size_t col = run.col; col < run.col + run.length; ++col) {
+            drawCell(run.row, col);
+          }
+        }
+      }
+
+      moveTo(game.height() + 2, 1);
+      this->buffer += "\033[K";
+      this->buffer += footer;
+
+      this->flush();
+
+      this->dirty.clear();
+      this->stale = false;
+      this->shownWidth = width;
+      this->shownHeader = header;
+    }
+
+  private:
+    void moveTo(size_t row, size_t col) {
+      this->buffer += "\033[" + std::to_string(row) + ';' + std::to_string(col) + 'H';
+    }
+
+    // Write the cell at index, only moving the cursor when it does not follow the cell written before
+    void writeCell(const Cell& cell, size_t index, size_t width) {
+      if (this->cursor != index) {
+        moveTo(index / width + 2, index % width + 1);
+      }
+
+      if (cell.selected) {
+        this->buffer += SELECTED_BACKGROUND;
+      }
+      this->buffer += *cell.colour;
+      if (cell.glyph == '#') {
+        this->buffer += "■";
+      } else {
+        this->buffer += cell.glyph;
+      }
+      this->buffer += "\033[0m";
+
+      this->cursor = (index + 1) % width == 0 ? SIZE_MAX : index + 1;
+    }
+
+    void flush() {
+      const char* data = this->buffer.data();
+      size_t remaining = this->buffer.size();
+
+      while (remaining > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, remaining);
+        if (written < 0) {
+          return;
+        }
+
+        data += written;
+        remaining -= written;
+      }
+    }
+
+  private:
+    // What is on screen
+    std::vector<Cell> cells;
+    size_t shownWidth = 0;
+    std::string shownHeader;
+
+    // Tiles to look at in the next frame, unless every tile is
+    std::vector<minesweeper::game::change_set::run> dirty;
+    bool stale = false;
+
+    std::string buffer;
+    size_t cursor = SIZE_MAX;
+};
+
+// Reads keys one at a time, with the terminal in raw mode for as long as the keyboard exists
+class Keyboard {
+  public:
+    Keyboard() {
+      if (tcgetattr(STDIN_FILENO, &original) != 0) {
+        return;
+      }
+
+      termios raw = original;
+      raw.c_lflag &= ~(ICANON | ECHO);
+      raw.c_cc[VMIN] = 1;
+      raw.c_cc[VTIME] = 0;
+      active = tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == 0;
+
+      // Put the terminal back if interrupted
+      if (active) {
+        std::signal(SIGINT, [](int) {
+          tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+          _exit(130);
+        });
+      }
+    }
+
+    ~Keyboard() {
+      if (active) {
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+      }
+    }
+
+    // Wait up to timeout milliseconds for a key, or for ever if it is negative, then take every other key already
+    // waiting, so a burst of repeats is handled before the next redraw. Arrow keys are translated to the '<', '>', '^'
+    // and 'v' commands, other escape sequences are dropped, and the end of input reads as 'q'.
+    std::string read(int timeout) {
+      std::string keys;
+
+      pollfd input{STDIN_FILENO, POLLIN, 0};
+      while (true) {
+        while (poll(&input, 1, timeout) > 0) {
+          char bytes[256];
+          ssize_t count = ::read(STDIN_FILENO, bytes, sizeof(bytes));
+          if (count <= 0) {
+            return keys + 'q';
+          }
+
+          pending.append(bytes, count);
+          timeout = 0;
+        }
+
+        const bool complete = this->translate(keys, false);
+        if (complete) {
+          return keys;
+        }
+
+        // An escape sequence was cut short, so give the rest of it a moment to arrive before taking the escape as a
+        // key of its own
+        if (poll(&input, 1, ESCAPE_TIMEOUT) <= 0) {
+          this->translate(keys, true);
+          return keys;
+        }
+        timeout = 0;
+      }
+    }
+
+  private:
+    // Milliseconds to wait for the rest of an escape sequence, which arrives all at once when a key sends it
+    static constexpr int ESCAPE_TIMEOUT = 50;
+
+    // Bytes in the escape sequence at offset: an escape on its own, a CSI sequence up to its final byte, or an SS3
+    // sequence of one byte. Returns 0 when the input ends before the sequence does.
+    static size_t sequenceLength(const std::string& bytes, size_t offset) {
+      if (offset + 1 >= bytes.size()) {
+        return 0;
+      }
+
+      if (bytes[offset + 1] == 'O') {
+        return offset + 2 < bytes.size() ? 3 : 0;
+      } else if (bytes[offset + 1] != '[') {
+        return 1;
+      }
+
+      size_t end = offset + 2;
+      while (end < bytes.size() && bytes[end] >= 0x20 && bytes[end] <= 0x3f) {
+        ++end;
+      }
+      if (end == bytes.size()) {
+        return 0;
+      }
+
+      // Anything but a final byte ends the sequence early, and is read as a key
+      return bytes[end] >= 0x40 && bytes[end] <= 0x7e ? end - offset + 1 : end - offset;
+    }
+
+    // Turn the pending bytes into commands. Returns false if they end partway through an escape sequence, which is
+    // left pending unless flushing, when the escape is taken as a key of its own and dropped.
+    bool translate(std::string& keys, bool flush) {
+      size_t i = 0;
+      bool complete = true;
+      while (i < pending.size()) {
+        if (pending[i] != '\033') {
+          keys += std::tolower(static_cast<unsigned char>(pending[i++]));
+          continue;
+        }
+
+        size_t length = sequenceLength(pending, i);
+        if (length == 0 && !flush) {
+          complete = false;
+          break;
+        }
+        length = std::max<size_t>(length, 1);
+
+        // Arrows, including with modifiers, end in A to D
+        if (length > 2) {
+          switch (pending[i + length - 1]) {
+            case 'A':
+              keys += '^';
+              break;
+            case 'B':
+              keys += 'v';
+              break;
+            case 'C':
+              keys += '>';
+              break;
+            case 'D':
+              keys += '<';
+              break;
+          }
+        }
+
+        i += length;
+      }
+      pending.erase(0, i);
+
+      return complete;
+    }
+
+    static inline termios original;
+    bool active = false;
+    std::string pending;
+};
+
 template<typename T>
 static T wrap(T value, const T& min, const T& max) {
   if (max < min) {
@@ -28,66 +348,112 @@ static T wrap(T value, const T& min, const T& max) {
   return value % (max - min);
 }
 
-int main(int argc, char** argv) {
-  if (argc < 4) {
-    std::cout << "USAGE: command [width] [height] [mine count]" << std::endl;
-    return 1;
-  }
-  while (true) {
-    minesweeper::game game = minesweeper::game(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+// Step through a recorded game, one action per key press
+static int playBack(const std::string& path) {
+  const minesweeper::replay recording = minesweeper::replay::load(path);
+  minesweeper::replay::player player(recording);
+  minesweeper::game game(1, 1, 0);
+  recording.deal(game);
 
-    const auto& grid = game.getGrid();
+  Screen screen;
+  Keyboard keyboard;
+  bool redraw = true;
+  while (!player.done()) {
+    if (redraw) {
+      screen.draw(game, "Action " + std::to_string(player.position()) + '/' + std::to_string(recording.size()), "n: next action, e: skip to the end, q: quit",
+          [](const minesweeper::game::tile& t, size_t, size_t) {
+            return playingCell(t);
+          });
+    }
 
-    int selectedRow = 0, selectedCol = 0;
-    while (!game.isAllExceptMinesRevealed()) {
-      // Print the game state
-      system("clear");
+    const std::string keys = keyboard.read(FRAME_TIME);
+    redraw = !keys.empty();
+    for (const char& c : keys) {
+      switch (c) {
+        case 'n':
+          if (!player.done()) {
+            screen.mark(player.step(game));
+          }
+          break;
+        case 'e':
+          player.fastForward(game);
+          screen.invalidate();
+          break;
+        case 'q':
+          return 0;
+      }
+    }
+  }
 
-      std::cout << game.flagCount() << '/' << game.mineCount() << '\n';
+  screen.invalidate();
+  screen.draw(game, game.state() == minesweeper::game::status::PLAYING ? "End of replay" : game.state() == minesweeper::game::status::LOST ? "Lost" : "Won", "",
+      [](const minesweeper::game::tile& t, size_t, size_t) {
+        return finalCell(t);
+      });
+  std::cout << std::endl;
 
-      for (size_t row = 0; row < game.height(); ++row) {
-        for (size_t col = 0; col < game.width(); ++col) {
-          const auto& t = grid.at(row).at(col);
+  return 0;
+}
 
-          if (row == static_cast<size_t>(selectedRow) && col == static_cast<size_t>(selectedCol)) {
-            std::cout << "\033[100m";
-          }
+int main(int argc, char** argv) {
+  if (argc == 2 && std::string(argv[1]).starts_with("replay=")) {
+    return playBack(std::string(argv[1]).substr(7));
+  }
 
-          if (!t.isRevealed() && !t.isFlagged()) {
-            std::cout << "■";
-          } else {
-            if (t.isFlagged()) {
-            } else if (t.isMine()) {
-              std::cout << "\033[41m";
-            } else {
-              std::cout << NUMCOLOURS[t.adjacentMineCount()];
-            }
-            std::cout << (char) t;
-          }
+  // Deal boards which can be solved from the first click without guessing, or record each game to a file
+  bool noGuess = false, valid = argc >= 4;
+  std::string recordPath;
+  for (int i = 4; i < argc; ++i) {
+    const std::string option = argv[i];
+    if (option == "no-guess") {
+      noGuess = true;
+    } else if (option.starts_with("record=")) {
+      recordPath = option.substr(7);
+    } else {
+      valid = false;
+    }
+  }
 
-          std::cout << "\033[0m";
-        }
-        std::cout << '\n';
-      }
+  if (!valid) {
+    std::cout << "USAGE: command [width] [height] [mine count] [no-guess] [record=file]" << std::endl;
+    std::cout << "       command replay=file" << std::endl;
+    return 1;
+  }
 
-      if (game.isMineRevealed()) {
-        break;
-      }
+  Screen screen;
+  Keyboard keyboard;
+  std::random_device seeds;
+  while (true) {
+    minesweeper::game game = minesweeper::game(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+    game.setUndoHistory(true);
 
-      std::cout.flush();
-      std::cout << "Input: ";
-      std::cout.flush();
+    std::optional<minesweeper::replay> recording;
+    if (!recordPath.empty()) {
+      recording.emplace(((std::uint64_t)seeds() << 32) | seeds(), game.width(), game.height(), game.mineCount());
+      recording->deal(game);
+    }
 
-      // Get user input
-      std::string input;
-      std::cin >> input;
+    int selectedRow = 0, selectedCol = 0;
 
-      // Set input to lowercase
-      // https://stackoverflow.com/a/313990
-      std::transform(input.begin(), input.end(), input.begin(), [](unsigned char c){ return std::tolower(c); });
+play:
+    screen.invalidate();
+    bool redraw = true;
+    while (game.state() == minesweeper::game::status::PLAYING) {
+      // Print the game state
+      if (redraw) {
+        screen.draw(game, std::to_string(game.flagCount()) + '/' + std::to_string(game.mineCount()), "Arrows: move, r: reveal, f: flag, u: undo, y: redo, s: new game, q: quit",
+            [&](const minesweeper::game::tile& t, size_t row, size_t col) {
+              Cell cell = playingCell(t);
+              cell.selected = row == static_cast<size_t>(selectedRow) && col == static_cast<size_t>(selectedCol);
+              return cell;
+            });
+      }
 
-      // Process input
-      for (const char& c : input) {
+      // Process every key pressed since the last frame
+      const int shownRow = selectedRow, shownCol = selectedCol;
+      const std::string keys = keyboard.read(FRAME_TIME);
+      redraw = !keys.empty();
+      for (const char& c : keys) {
         switch (c) {
           case '>':
             selectedCol = wrap(selectedCol + 1, 0, (int)game.width());
@@ -102,58 +468,99 @@ int main(int argc, char** argv) {
             selectedRow = wrap(selectedRow - 1, 0, (int)game.height());
             break;
           case 'r':
-            game.reveal(selectedRow, selectedCol);
+            if (noGuess && recording) {
+              recording->revealWithoutGuessing(game, selectedRow, selectedCol);
+            } else if (noGuess) {
+              minesweeper::revealWithoutGuessing(game, selectedRow, selectedCol);
+            } else if (recording) {
+              recording->reveal(game, selectedRow, selectedCol);
+            } else {
+              game.reveal(selectedRow, selectedCol);
+            }
+            screen.mark(game.lastChanges());
             break;
           case 'f':
-            game.flag(selectedRow, selectedCol);
+            if (recording) {
+              recording->flag(game, selectedRow, selectedCol);
+            } else {
+              game.flag(selectedRow, selectedCol);
+            }
+            screen.mark(game.lastChanges());
+            break;
+          case 'u':
+            if (recording) {
+              recording->undo(game);
+            } else {
+              game.undo();
+            }
+            screen.mark(game.lastChanges());
+            break;
+          case 'y':
+            if (recording) {
+              recording->redo(game);
+            } else {
+              game.redo();
+            }
+            screen.mark(game.lastChanges());
             break;
           case 'q':
+            if (recording) {
+              recording->save(recordPath);
+            }
             return 0;
           case 's':
             goto newGame;
         }
       }
-    }
-
-    // Print final game state
-    system("clear");
 
-    if (game.isMineRevealed()) {
-      std::cout << "You lose!" << std::endl;
-    } else if (game.isAllExceptMinesRevealed()) {
-      std::cout << "You win!" << std::endl;
+      // Move the highlight from where it was drawn
+      if (selectedRow != shownRow || selectedCol != shownCol) {
+        screen.mark(shownRow, shownCol);
+        screen.mark(selectedRow, selectedCol);
+      }
     }
 
-    for (size_t row = 0; row < game.height(); ++row) {
-      for (size_t col = 0; col < game.width(); ++col) {
-        const auto& t = grid.at(row).at(col);
+    // Show where the mines were, but let the move that lost be taken back
+    if (game.state() == minesweeper::game::status::LOST) {
+      screen.invalidate();
+      screen.draw(game, "You lose!", "u: undo, s: new game, q: quit",
+          [](const minesweeper::game::tile& t, size_t, size_t) {
+            return finalCell(t);
+          });
 
-        if (t.isFlagged()) {
-          if (t.isMine()) {
-            std::cout << "\033[42m";
-          } else {
-            std::cout << "\033[41m";
-          }
-        } else if (t.isMine()) {
-          if (t.isRevealed()) {
-            std::cout << "\033[41m";
+      char choice = 0;
+      while (choice == 0) {
+        for (const char& c : keyboard.read(FRAME_TIME)) {
+          if (c == 'u' || c == 's' || c == 'q') {
+            choice = c;
+            break;
           }
-        } else {
-          std::cout << NUMCOLOURS[t.adjacentMineCount()];
         }
+      }
 
-        if (t.isRevealed() || t.isMine() || t.isFlagged()) {
-          std::cout << (char) t;
+      if (choice == 'u') {
+        if (recording) {
+          recording->undo(game);
         } else {
-          std::cout << "\033[0m■";
+          game.undo();
         }
-
-        std::cout << "\033[0m";
+        goto play;
+      } else if (choice == 's') {
+        goto newGame;
       }
+    }
 
-      std::cout << '\n';
+    if (recording) {
+      recording->save(recordPath);
     }
-    std::cout.flush();
+
+    // Print final game state
+    screen.invalidate();
+    screen.draw(game, game.state() == minesweeper::game::status::LOST ? "You lose!" : "You win!", "",
+        [](const minesweeper::game::tile& t, size_t, size_t) {
+          return finalCell(t);
+        });
+    std::cout << std::endl;
 
     return 0;
 